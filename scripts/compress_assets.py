@@ -0,0 +1,23 @@
+# PlatformIO pre-script: gzip the web UI sources in web/ into data/ so
+# `pio run -t buildfs` / `-t uploadfs` put pre-compressed assets in the
+# LittleFS image. mtime is fixed so unchanged sources give identical files.
+import gzip
+import os
+
+Import("env")
+
+src_dir = os.path.join(env.subst("$PROJECT_DIR"), "web")
+data_dir = env.subst("$PROJECT_DATA_DIR")
+
+os.makedirs(data_dir, exist_ok=True)
+for name in sorted(os.listdir(src_dir)):
+    src = os.path.join(src_dir, name)
+    dst = os.path.join(data_dir, name + ".gz")
+    if os.path.exists(dst) and os.path.getmtime(dst) >= os.path.getmtime(src):
+        continue
+    with open(src, "rb") as f:
+        raw = f.read()
+    with open(dst, "wb") as f:
+        with gzip.GzipFile(filename="", mode="wb", fileobj=f, compresslevel=9, mtime=0) as gz:
+            gz.write(raw)
+    print("Compressed %s -> %s (%d -> %d bytes)" % (name, os.path.relpath(dst), len(raw), os.path.getsize(dst)))
@@ -0,0 +1,258 @@
+#include "bench.h"
+
+struct BenchOp{
+  const char*name;
+  BenchFn fn;
+  size_t heapPerEvent;
+};
+
+static void benchParse(Print&out){
+  std::vector<LogEntry>entries=parseLog();
+  out.print(entries.size());
+}
+
+static void benchRebuild(Print&){rebuildAggregates();}
+
+static void benchStats(Print&out){
+  Stats s=calculateStats();
+  out.print(formatDuration(s.monthOff));
+}
+
+static void benchExportCsv(Print&out){
+  LogReader reader;
+  reader.open();
+  writeLogCsv(out,reader);
+}
+
+static void benchExportJson(Print&out){
+  LogReader reader;
+  LogQuery q;
+  q.limit=SIZE_MAX;
+  if(reader.open())resolveLogQuery(reader,q,0);
+  writeLogJson(out,reader,q);
+}
+
+// A full pass, not just the records added since the last call
+static void benchOutages(Print&out){
+  resetOutageStats();
+  out.print(calculateOutageStats().percentile(95));
+}
+
+// Formats every record's timestamp, as the history table does per row
+static void benchFormatTimes(Print&out){
+  LogReader reader;
+  LogRecord r;
+  if(!reader.open())return;
+  while(reader.next(r))out.print(getTimeString(r.timestamp));
+  reader.close();
+}
+
+static time_t benchEnd=0; // the newest synthetic record
+
+// Decodes the whole archive, the counterpart of parse
+static void benchArchiveRead(Print&out){
+  ArchiveReader reader;
+  LogRecord r;
+  size_t n=0;
+  if(reader.open()){
+    while(reader.next(r))n++;
+    reader.close();
+  }
+  out.print(n);
+}
+
+// The last 7 days: older blocks are skipped by their headers
+static void benchArchiveRange(Print&out){
+  ArchiveReader reader;
+  LogRecord r;
+  size_t n=0;
+  if(reader.open()){
+    reader.range(benchEnd-7*86400L,0);
+    while(reader.next(r))n++;
+    reader.close();
+  }
+  out.print(n);
+}
+
+static BenchOp benchOps[BENCH_MAX_OPS]={
+  {"parse",benchParse,sizeof(LogEntry)},
+  {"rebuild",benchRebuild,0},
+  {"stats",benchStats,0},
+  {"export_csv",benchExportCsv,0},
+  {"export_json",benchExportJson,0},
+  {"format_times",benchFormatTimes,0},
+  {"outages",benchOutages,0},
+  {"archive_read",benchArchiveRead,0},
+  {"archive_range",benchArchiveRange,0},
+};
+static size_t benchOpCount=9;
+
+static const size_t benchDefaultSizes[]={100,1000,5000,10000,50000};
+
+bool addBenchOp(const char*name,BenchFn fn,size_t heapPerEvent){
+  if(benchOpCount>=BENCH_MAX_OPS)return false;
+  benchOps[benchOpCount++]={name,fn,heapPerEvent};
+  return true;
+}
+
+size_t parseBenchSizes(const String&s,size_t*sizes,size_t max){
+  size_t n=0;
+  const char*p=s.c_str();
+  while(*p&&n<max){
+    long v=strtol(p,(char**)&p,10);
+    if(v>0)sizes[n++]=v;
+    while(*p&&(*p<'0'||*p>'9'))p++;
+  }
+  if(n>0)return n;
+  for(;n<max&&n<sizeof(benchDefaultSizes)/sizeof(benchDefaultSizes[0]);n++)sizes[n]=benchDefaultSizes[n];
+  return n;
+}
+
+// Discards output, counting bytes.
+class CountingPrint:public Print{
+public:
+  size_t bytes=0;
+  size_t write(uint8_t)override{bytes++;return 1;}
+  size_t write(const uint8_t*,size_t n)override{bytes+=n;return n;}
+};
+
+// Alternating OFF/ON records spread evenly over the BENCH_SPAN before end,
+// with pseudo-random (but repeatable) outage lengths.
+static bool generateBenchLog(size_t events,time_t end){
+  uint32_t seed=12345;
+  time_t gap=std::max(BENCH_SPAN/(long)events,2L);
+  time_t t=end-gap*(time_t)events;
+  LogRecord batch[16];
+  size_t n=0;
+  for(size_t i=0;i<events;i++){
+    seed=seed*1103515245+12345;
+    LogRecord&r=batch[n++];
+    r.type=(i&1)?EV_ON:EV_OFF;
+    r.duration=(i&1)?gap:1+(seed>>16)%gap;
+    r.timestamp=(uint32_t)t;
+    t+=gap;
+    if(n==16||i+1==events){
+      if(appendLogRecords(batch,n)!=n)return false;
+      n=0;
+      yield();
+    }
+  }
+  return true;
+}
+
+static void benchLine(Print&out,const char*op,size_t events){
+  out.print("{\"op\":\"");
+  out.print(op);
+  out.print("\",\"events\":");
+  out.print(events);
+}
+
+static void runBenchOp(Print&out,const BenchOp&op,size_t events){
+  benchLine(out,op.name,events);
+  size_t freeHeap=hal.heap->freeBytes();
+  if(op.heapPerEvent&&freeHeap&&events*op.heapPerEvent>freeHeap/2){
+    out.println(",\"skipped\":\"heap\"}");
+    return;
+  }
+  uint32_t total=0,best=UINT32_MAX;
+  size_t peak=0,allocs=0,bytes=0,runs=0,lookups=0;
+  while(runs<BENCH_MAX_RUNS&&total<BENCH_BUDGET_US){
+    CountingPrint sink;
+    resetCalendarCache();
+    uint32_t calls=calendarLookups;
+    hal.heap->begin();
+    uint32_t t0=hal.clock->micros();
+    op.fn(sink);
+    uint32_t us=hal.clock->micros()-t0;
+    lookups+=calendarLookups-calls;
+    peak=std::max(peak,hal.heap->peakBytes());
+    allocs+=hal.heap->allocations();
+    bytes=sink.bytes;
+    total+=us;
+    best=std::min(best,us);
+    runs++;
+    yield();
+  }
+  out.print(",\"runs\":");
+  out.print(runs);
+  out.print(",\"mean_us\":");
+  out.print(total/runs);
+  out.print(",\"min_us\":");
+  out.print(best);
+  out.print(",\"peak_heap\":");
+  out.print(peak);
+  out.print(",\"allocs\":");
+  out.print(allocs/runs);
+  out.print(",\"localtime\":");
+  out.print(lookups/runs);
+  out.print(",\"bytes\":");
+  out.print(bytes);
+  out.println("}");
+}
+
+void runBenchmarks(Print&out,const char*platform,const size_t*sizes,size_t count){
+  String savedDir=logDir,savedAgg=aggFile;
+  std::vector<Segment>savedSegments;
+  savedSegments.swap(segments);
+  uint32_t savedBudget=retentionBytes,savedArchive=archiveBudget;
+  logDir="/bench";
+  aggFile="/bench/stats.bin";
+  retentionBytes=0;
+  archiveBudget=0;
+  time_t end=hal.clock->now();
+  if(end<BENCH_SPAN)end=BENCH_SPAN; // clock not set yet
+  benchEnd=end;
+  
+  out.print("{\"bench\":\"powerlog\",\"platform\":\"");
+  out.print(platform);
+  out.print("\",\"build\":\"" __DATE__ " " __TIME__ "\",\"record_size\":");
+  out.print(sizeof(LogFrame));
+  out.print(",\"free_heap\":");
+  out.print(hal.heap->freeBytes());
+  out.println("}");
+  
+  for(size_t i=0;i<count;i++){
+    size_t events=sizes[i];
+    removeLogSegments(); // the previous size's log
+    FSInfo info;
+    hal.fs->info(info);
+    benchLine(out,"generate",events);
+    // Room for the log plus the aggregates, with a margin for LittleFS
+    if(info.totalBytes&&info.usedBytes+2*events*sizeof(LogFrame)>info.totalBytes){
+      out.println(",\"skipped\":\"space\"}");
+      continue;
+    }
+    uint32_t t0=hal.clock->micros();
+    bool ok=generateBenchLog(events,end);
+    uint32_t us=hal.clock->micros()-t0;
+    if(!ok){
+      out.println(",\"skipped\":\"write\"}");
+      continue;
+    }
+    out.print(",\"runs\":1,\"mean_us\":");
+    out.print(us);
+    out.println("}");
+    // The whole log as one archive, so archive_read compares with parse
+    benchLine(out,"archive",events);
+    t0=hal.clock->micros();
+    archiveLogRecords(logFirst(),logTotal());
+    us=hal.clock->micros()-t0;
+    out.print(",\"runs\":1,\"mean_us\":");
+    out.print(us);
+    out.print(",\"bytes\":");
+    out.print(archiveBytes());
+    out.println("}");
+    rebuildAggregates();
+    for(size_t j=0;j<benchOpCount;j++)runBenchOp(out,benchOps[j],events);
+  }
+  
+  removeLogSegments();
+  hal.fs->remove(aggFile);
+  logDir=savedDir;
+  aggFile=savedAgg;
+  segments.swap(savedSegments);
+  retentionBytes=savedBudget;
+  archiveBudget=savedArchive;
+  loadAggregates();
+  resetOutageStats();
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <Arduino.h>
+#include "powerlog.h"
+
+// Benchmarks for the logging and statistics core, run on synthetic logs
+// of increasing size. Results go to out as one JSON object per line so
+// runs from different firmware versions can be diffed. Triggered by the
+// "bench" serial command on the device and by "program bench" natively.
+
+#define BENCH_MAX_OPS 12
+#define BENCH_MAX_SIZES 8
+#define BENCH_MAX_RUNS 10
+#define BENCH_BUDGET_US 500000 // stop repeating an op after this much time
+#define BENCH_SPAN (30*86400L) // synthetic logs cover the last 30 days
+
+// out receives whatever the operation renders; it only counts bytes.
+typedef void(*BenchFn)(Print&out);
+
+// Registers an operation to time on every log size. heapPerEvent is the
+// RAM the op needs per log record; sizes that would not fit in half the
+// free heap are skipped.
+bool addBenchOp(const char*name,BenchFn fn,size_t heapPerEvent=0);
+
+// Parses "100,1000,..." into sizes; returns the default set for "".
+size_t parseBenchSizes(const String&s,size_t*sizes,size_t max);
+
+// Runs every registered op on each size. The live log is left untouched.
+void runBenchmarks(Print&out,const char*platform,const size_t*sizes,size_t count);
@@ -0,0 +1,216 @@
+#include <LittleFS.h>
+#include "cache.h"
+#include "metrics.h"
+
+struct CacheSlot{
+  uint32_t key;
+  uint32_t generation; // logGeneration when stored
+  uint32_t used; // millis() of the last use
+  uint8_t*ram; // the body, or nullptr when it is in the slot's file
+  size_t len;
+  bool valid;
+};
+
+static CacheSlot slots[CACHE_SLOTS];
+static uint32_t oversized[CACHE_OVERSIZED]; // requestKey()s, 0 when unused
+static int oversizedNext=0;
+static uint32_t salt=0;
+static uint32_t hitCount=0,missCount=0,notModifiedCount=0;
+
+static String slotPath(int i){
+  return "/cache/"+String(i)+".bin";
+}
+
+// A body being captured past CACHE_RAM_MAX, renamed to its slot on commit
+#define CAPTURE_PATH "/cache/new.bin"
+
+static bool isOversized(uint32_t request){
+  for(uint32_t o:oversized){
+    if(o==request)return true;
+  }
+  return false;
+}
+
+static void dropSlot(int i){
+  CacheSlot&s=slots[i];
+  if(s.valid&&!s.ram)LittleFS.remove(slotPath(i));
+  free(s.ram);
+  s.ram=nullptr;
+  s.len=0;
+  s.valid=false;
+}
+
+uint32_t requestKey(ESP8266WebServer&server){
+  const String&uri=server.uri();
+  uint32_t crc=crc32Update(0,(const uint8_t*)uri.c_str(),uri.length());
+  for(int i=0;i<server.args();i++){
+    const String&name=server.argName(i);
+    const String&value=server.arg(i);
+    crc=crc32Update(crc,(const uint8_t*)"&",1);
+    crc=crc32Update(crc,(const uint8_t*)name.c_str(),name.length());
+    crc=crc32Update(crc,(const uint8_t*)"=",1);
+    crc=crc32Update(crc,(const uint8_t*)value.c_str(),value.length());
+  }
+  return crc|1; // never 0, which marks an unused oversized entry
+}
+
+uint32_t cacheKey(ESP8266WebServer&server,uint32_t request){
+  if(!salt)salt=ESP.random()|1;
+  uint32_t crc=logStateKey(salt,time(nullptr));
+  return crc32Update(crc,(const uint8_t*)&request,sizeof(request));
+}
+
+// no-cache: browsers keep the body but revalidate it on every use
+bool serveCached(ESP8266WebServer&server,uint32_t key,const char*type){
+  char etag[12];
+  snprintf(etag,sizeof(etag),"\"%08lx\"",(unsigned long)key);
+  server.sendHeader("ETag",etag);
+  server.sendHeader("Cache-Control","no-cache");
+  if(server.header("If-None-Match")==etag){
+    notModifiedCount++;
+    server.send(304);
+    return true;
+  }
+  int found=-1;
+  for(int i=0;i<CACHE_SLOTS;i++){
+    if(!slots[i].valid)continue;
+    if(slots[i].generation!=logGeneration)dropSlot(i); // can never match again
+    else if(slots[i].key==key)found=i;
+  }
+  if(found>=0){
+    CacheSlot&s=slots[found];
+    if(s.ram){
+      server.setContentLength(s.len);
+      server.send(200,type,"");
+      server.sendContent((const char*)s.ram,s.len);
+      countResponseBytes(s.len);
+    }else{
+      File f=LittleFS.open(slotPath(found),"r");
+      if(!f){
+        dropSlot(found);
+        missCount++;
+        return false;
+      }
+      countResponseBytes(server.streamFile(f,type));
+      f.close();
+    }
+    s.used=millis();
+    hitCount++;
+    return true;
+  }
+  missCount++;
+  return false;
+}
+
+CacheCapture::CacheCapture(uint32_t key,uint32_t request):key(key),request(request){
+  failed=isOversized(request);
+}
+
+CacheCapture::~CacheCapture(){
+  if(file){
+    file.close();
+    LittleFS.remove(CAPTURE_PATH);
+  }
+  free(ram);
+}
+
+// Always reports n written: a body that cannot be stored is still sent.
+size_t CacheCapture::write(const uint8_t*data,size_t n){
+  if(failed)return n;
+  if(len+n>CACHE_FILE_MAX){
+    failed=true;
+    oversized[oversizedNext]=request;
+    oversizedNext=(oversizedNext+1)%CACHE_OVERSIZED;
+    if(file){
+      file.close();
+      LittleFS.remove(CAPTURE_PATH);
+    }
+    return n;
+  }
+  if(!file&&len+n<=CACHE_RAM_MAX){
+    if(!ram)ram=(uint8_t*)malloc(CACHE_RAM_MAX);
+    if(!ram){
+      failed=true;
+      return n;
+    }
+    memcpy(ram+len,data,n);
+  }else{
+    if(!file){
+      // Spill what is in RAM to the capture file
+      file=LittleFS.open(CAPTURE_PATH,"w");
+      if(!file||(len&&file.write(ram,len)!=len)){
+        failed=true;
+        return n;
+      }
+      free(ram);
+      ram=nullptr;
+    }
+    if(file.write(data,n)!=n){
+      failed=true;
+      return n;
+    }
+  }
+  len+=n;
+  return n;
+}
+
+// Takes over the least recently used slot, an empty one if there is any.
+void CacheCapture::commit(){
+  if(failed||!len)return; // nothing worth keeping
+  int slot=0;
+  for(int i=1;i<CACHE_SLOTS;i++){
+    if(!slots[slot].valid)break;
+    if(!slots[i].valid||(int32_t)(slots[i].used-slots[slot].used)<0)slot=i;
+  }
+  dropSlot(slot);
+  CacheSlot&s=slots[slot];
+  if(file){
+    file.close();
+    file=File();
+    if(!LittleFS.rename(CAPTURE_PATH,slotPath(slot))){
+      LittleFS.remove(CAPTURE_PATH);
+      return;
+    }
+    s.ram=nullptr;
+  }else{
+    uint8_t*fit=(uint8_t*)realloc(ram,len);
+    if(!fit)return;
+    s.ram=fit;
+    ram=nullptr;
+  }
+  s.key=key;
+  s.generation=logGeneration;
+  s.used=millis();
+  s.len=len;
+  s.valid=true;
+  failed=true; // committed once
+}
+
+void clearResponseCache(){
+  for(int i=0;i<CACHE_SLOTS;i++){
+    dropSlot(i);
+    LittleFS.remove(slotPath(i)); // also left over from the last boot
+  }
+  LittleFS.remove(CAPTURE_PATH);
+  memset(oversized,0,sizeof(oversized));
+}
+
+uint32_t cacheHits(){
+  return hitCount;
+}
+
+uint32_t cacheMisses(){
+  return missCount;
+}
+
+uint32_t cacheNotModified(){
+  return notModifiedCount;
+}
+
+size_t cacheRamBytes(){
+  size_t bytes=0;
+  for(const CacheSlot&s:slots){
+    if(s.valid&&s.ram)bytes+=s.len;
+  }
+  return bytes;
+}
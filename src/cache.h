@@ -0,0 +1,56 @@
+#pragma once
+#include <ESP8266WebServer.h>
+#include "powerlog.h"
+
+// Response cache for pages and exports that depend only on the log, the
+// request arguments and the hour. The key is a CRC32 of those plus
+// logGeneration, which every append, clearLog() and retention bump, and a
+// per-boot salt, so an entry can never be served stale. Every response
+// carries the key as its ETag, so a repeat poll is a 304 without
+// rendering anything. Bodies up to CACHE_RAM_MAX are kept in RAM, larger
+// ones in /cache/<slot>.bin; bodies over CACHE_FILE_MAX are not stored
+// (the ETag still applies). Slots are reused least recently used first,
+// and only once a body is complete and fits.
+//
+// A request whose body outgrew CACHE_FILE_MAX (a full export of a long
+// log) is remembered by its uri and arguments and not captured again, as
+// the log only grows until it is cleared: it would otherwise write 32 KB
+// to flash and throw it away on every request.
+
+#define CACHE_SLOTS 4
+#define CACHE_RAM_MAX 1024
+#define CACHE_FILE_MAX 32768
+#define CACHE_OVERSIZED 4 // requests remembered as too large to store
+
+uint32_t requestKey(ESP8266WebServer&server); // uri and arguments only
+uint32_t cacheKey(ESP8266WebServer&server,uint32_t request);
+
+// Sends the ETag and revalidation headers for key, then the 304 or the
+// stored body. false on a miss: the caller renders the response (the
+// headers are already queued) through a CacheCapture.
+bool serveCached(ESP8266WebServer&server,uint32_t key,const char*type);
+
+// Collects a response body as it is sent; commit() stores it under key
+// once the response is complete. Only one capture may be open at a time.
+// Does nothing for a request remembered as oversized.
+class CacheCapture:public Print{
+public:
+  CacheCapture(uint32_t key,uint32_t request);
+  ~CacheCapture();
+  size_t write(uint8_t c)override{return write(&c,1);}
+  size_t write(const uint8_t*data,size_t n)override;
+  void commit();
+private:
+  uint32_t key;
+  uint32_t request;
+  uint8_t*ram=nullptr;
+  File file;
+  size_t len=0;
+  bool failed=false;
+};
+
+void clearResponseCache(); // drops every entry, its file and the oversized list
+uint32_t cacheHits();
+uint32_t cacheMisses();
+uint32_t cacheNotModified();
+size_t cacheRamBytes();
@@ -0,0 +1,117 @@
+#include <ESP8266WiFi.h>
+#include <algorithm>
+#include "events.h"
+
+struct EventClient{
+  WiFiClient client;
+  bool active;
+  uint8_t drops;
+};
+
+static EventClient eventClients[SSE_MAX_CLIENTS];
+static uint32_t sentCount=0;
+static uint32_t dropCount=0;
+
+static void closeEventClient(EventClient&c){
+  c.client.stop();
+  c.client=WiFiClient();
+  c.active=false;
+}
+
+size_t eventClientCount(){
+  size_t n=0;
+  for(EventClient&c:eventClients){
+    if(c.active&&!c.client.connected())closeEventClient(c);
+    if(c.active)n++;
+  }
+  return n;
+}
+
+uint32_t eventsSent(){
+  return sentCount;
+}
+
+uint32_t eventsDropped(){
+  return dropCount;
+}
+
+// Keeps a copy of the request's connection, which holds it open after
+// the handler returns (as in the core's ServerSentEvents example).
+void handleEvents(ESP8266WebServer&server){
+  eventClientCount(); // reap closed streams
+  EventClient*slot=nullptr;
+  for(EventClient&c:eventClients){
+    if(!c.active){
+      slot=&c;
+      break;
+    }
+  }
+  if(!slot){
+    server.send(503,"text/plain","Too many event streams");
+    return;
+  }
+  slot->client=server.client();
+  slot->client.setNoDelay(true);
+  slot->client.print(F("HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n"
+    "Cache-Control: no-cache\r\nConnection: keep-alive\r\n\r\nretry: 5000\n\n"));
+  slot->active=true;
+  slot->drops=0;
+  sendStatusEvent();
+}
+
+void sendEvent(const char*event,const char*data){
+  char msg[SSE_MAX_EVENT];
+  int n=snprintf_P(msg,sizeof(msg),PSTR("event: %s\ndata: %s\n\n"),event,data);
+  if(n<0||n>=(int)sizeof(msg))return;
+  for(EventClient&c:eventClients){
+    if(!c.active)continue;
+    if(!c.client.connected()){
+      closeEventClient(c);
+      continue;
+    }
+    if(c.client.availableForWrite()<(size_t)n){
+      dropCount++;
+      if(++c.drops>=SSE_MAX_DROPS)closeEventClient(c);
+      continue;
+    }
+    c.client.write((const uint8_t*)msg,n);
+    c.drops=0;
+    sentCount++;
+  }
+}
+
+void sendLogEvent(size_t index,const LogRecord&r){
+  if(!eventClientCount())return;
+  char data[192],timeText[TIME_TEXT_LEN],durationText[DURATION_TEXT_LEN];
+  snprintf_P(data,sizeof(data),PSTR("{\"index\":%u,\"type\":\"%s\",\"cause\":\"%s\",\"time\":%lu,\"timeText\":\"%s\",\"duration\":%lu,\"durationText\":\"%s\"}"),
+    (unsigned)index,eventLabel(r.type),(EV_HAS_CAUSE(r.type)&&EV_CAUSE(r.type))?resetCauseName(EV_CAUSE(r.type)):"",
+    (unsigned long)r.timestamp,formatTime(r.timestamp,timeText),
+    (unsigned long)r.duration,r.duration?formatDuration(r.duration,durationText):"-");
+  sendEvent("log",data);
+}
+
+size_t statusJson(char*buf,size_t size){
+  time_t now=time(nullptr);
+  char timeText[TIME_TEXT_LEN],uptimeText[DURATION_TEXT_LEN];
+  int n=snprintf_P(buf,size,PSTR("{\"uptime\":%lu,\"uptimeText\":\"%s\",\"time\":%lu,\"timeText\":\"%s\",\"freeHeap\":%u,\"rssi\":%d}"),
+    (unsigned long)(millis()/1000),formatDuration(millis()/1000,uptimeText),
+    (unsigned long)now,formatTime(now,timeText),ESP.getFreeHeap(),
+    WiFi.status()==WL_CONNECTED?(int)WiFi.RSSI():0);
+  return n<0?0:std::min((size_t)n,size-1);
+}
+
+void sendStatusEvent(){
+  if(!eventClientCount())return;
+  char data[160];
+  statusJson(data,sizeof(data));
+  sendEvent("status",data);
+}
+
+void sendWifiEvent(bool connected){
+  if(!eventClientCount())return;
+  char data[96],ip[16]="";
+  if(connected)strlcpy(ip,WiFi.localIP().toString().c_str(),sizeof(ip));
+  snprintf_P(data,sizeof(data),PSTR("{\"connected\":%s,\"ip\":\"%s\",\"rssi\":%d}"),
+    connected?"true":"false",ip,connected?(int)WiFi.RSSI():0);
+  sendEvent("wifi",data);
+}
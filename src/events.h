@@ -0,0 +1,28 @@
+#pragma once
+#include <ESP8266WebServer.h>
+#include "powerlog.h"
+
+// Server-Sent Events on /events. Open dashboards get small JSON deltas
+// (new log records, status ticks, WiFi changes) instead of reloading
+// whole pages. At most SSE_MAX_CLIENTS streams are kept. An event is
+// written only if it fits the client's TCP send buffer, otherwise it is
+// dropped for that client, so a slow client never queues heap. After
+// SSE_MAX_DROPS drops in a row the client is closed.
+
+#define SSE_MAX_CLIENTS 3
+#define SSE_MAX_DROPS 8
+#define SSE_MAX_EVENT 256 // bytes, including the "event:"/"data:" framing
+#define SSE_STATUS_INTERVAL 5000
+
+void handleEvents(ESP8266WebServer&server);
+size_t eventClientCount();
+uint32_t eventsSent();
+uint32_t eventsDropped();
+
+// Broadcasts data (one line of JSON) as the named event
+void sendEvent(const char*event,const char*data);
+void sendLogEvent(size_t index,const LogRecord&r);
+// The status event's JSON (uptime, time, heap, RSSI), also /api/status
+size_t statusJson(char*buf,size_t size);
+void sendStatusEvent();
+void sendWifiEvent(bool connected);
@@ -0,0 +1,67 @@
+#pragma once
+#include <Arduino.h>
+#include <FS.h>
+#include <time.h>
+
+// Thin hardware abstraction for the logging and statistics core
+// (powerlog.cpp). The device build binds it to LittleFS, EEPROM, time()
+// and WiFi in hal_esp8266.cpp; the native build binds it to a host
+// directory, a RAM store, a settable clock and a replayed waveform in
+// native/hal_native.cpp.
+
+class Clock{
+public:
+  virtual ~Clock(){}
+  virtual time_t now()=0; // wall clock, below 100000 until synced
+  virtual uint32_t millis()=0;
+  virtual uint32_t micros()=0;
+};
+
+// Byte-addressed persistent store (EEPROM layout). Writes stay in RAM
+// until commit().
+class KeyValueStore{
+public:
+  virtual ~KeyValueStore(){}
+  virtual uint8_t read(int addr)=0;
+  virtual void write(int addr,uint8_t value)=0;
+  virtual bool commit()=0;
+};
+
+class Network{
+public:
+  virtual ~Network(){}
+  virtual bool connected()=0;
+  virtual int32_t rssi()=0;
+};
+
+// Raw 10-bit ADC reading of the supply divider (see supply.h). Called
+// from the sampling timer, so it must not block or allocate.
+class AnalogSource{
+public:
+  virtual ~AnalogSource(){}
+  virtual uint16_t read()=0;
+};
+
+// Heap instrumentation for the benchmarks. Between begin() and the
+// reads, peakBytes() is the high-water mark above the level at begin()
+// and allocations() counts malloc/new/realloc calls (0 if untracked).
+class HeapProbe{
+public:
+  virtual ~HeapProbe(){}
+  virtual void begin()=0;
+  virtual size_t peakBytes()=0;
+  virtual size_t allocations()=0;
+  virtual size_t freeBytes()=0;
+};
+
+struct Hal{
+  fs::FS*fs;
+  Clock*clock;
+  KeyValueStore*kv;
+  Network*net;
+  Print*console;
+  HeapProbe*heap;
+  AnalogSource*adc;
+};
+
+extern Hal hal;
@@ -0,0 +1,74 @@
+#include <ESP8266WiFi.h>
+#include <LittleFS.h>
+#include <EEPROM.h>
+#include "hal.h"
+#ifdef UMM_STATS_FULL
+#include <umm_malloc/umm_malloc.h>
+#endif
+
+class EspClock:public Clock{
+public:
+  time_t now()override{return time(nullptr);}
+  uint32_t millis()override{return ::millis();}
+  uint32_t micros()override{return ::micros();}
+};
+
+// EEPROM.begin() is called once in setup()
+class EepromStore:public KeyValueStore{
+public:
+  uint8_t read(int addr)override{return EEPROM.read(addr);}
+  void write(int addr,uint8_t value)override{EEPROM.write(addr,value);}
+  bool commit()override{return EEPROM.commit();}
+};
+
+class WiFiNetwork:public Network{
+public:
+  bool connected()override{return WiFi.status()==WL_CONNECTED;}
+  int32_t rssi()override{return WiFi.RSSI();}
+};
+
+// Peak and allocation counts need the umm_malloc statistics
+// (-DUMM_STATS_FULL, see [env:esp8266_bench]). Without them peakBytes()
+// only sees heap still held when it is read.
+class UmmHeapProbe:public HeapProbe{
+public:
+  void begin()override{
+    start=ESP.getFreeHeap();
+#ifdef UMM_STATS_FULL
+    umm_free_heap_size_min_reset();
+    startAllocs=umm_get_malloc_count()+umm_get_realloc_count();
+#endif
+  }
+  size_t peakBytes()override{
+#ifdef UMM_STATS_FULL
+    size_t low=umm_free_heap_size_min();
+#else
+    size_t low=ESP.getFreeHeap();
+#endif
+    return start>low?start-low:0;
+  }
+  size_t allocations()override{
+#ifdef UMM_STATS_FULL
+    return umm_get_malloc_count()+umm_get_realloc_count()-startAllocs;
+#else
+    return 0;
+#endif
+  }
+  size_t freeBytes()override{return ESP.getFreeHeap();}
+private:
+  size_t start=0;
+  size_t startAllocs=0;
+};
+
+class A0Source:public AnalogSource{
+public:
+  uint16_t read()override{return analogRead(A0);}
+};
+
+static EspClock espClock;
+static EepromStore eepromStore;
+static WiFiNetwork wifiNetwork;
+static UmmHeapProbe heapProbe;
+static A0Source a0Source;
+
+Hal hal={&LittleFS,&espClock,&eepromStore,&wifiNetwork,&Serial,&heapProbe,&a0Source};
@@ -1,9 +1,19 @@
 #include <ESP8266WiFi.h>
 #include <ESP8266WebServer.h>
 #include <FS.h>
+#include <LittleFS.h>
 #include <EEPROM.h>
+#include <Ticker.h>
 #include <time.h>
 #include <vector>
+#include <algorithm>
+#include "hal.h"
+#include "powerlog.h"
+#include "bench.h"
+#include "events.h"
+#include "metrics.h"
+#include "supply.h"
+#include "cache.h"
 
 ESP8266WebServer server(80);
 
@@ -14,57 +24,145 @@ ESP8266WebServer server(80);
 #define AP_SSID_ADDR 128
 #define AP_PASS_ADDR 192
 #define FLAG_ADDR 250
-#define LAST_RESET_ADDR 256
+// 256-259 unused (was the monthly reset stamp); RETENTION_ADDR 260
+// (3 bytes) is defined in powerlog.h
+
+#define MAX_TASKS 12 // 10 with SUPPLY_SENSE, plus room for new one-shots
+#define TASK_BUDGET_US 10000 // longer runs count as overruns
+
+#define RTC_ALIVE_OFFSET 32 // in 4-byte blocks; the first 128 bytes are left to OTA
+#define RTC_ALIVE_MAGIC 0x52544341
+#define RTC_ALIVE_INTERVAL 5000
+
+#define WIFI_CONNECT_TIMEOUT 20000
+#define NTP_SYNC_TIMEOUT 30000 // after this the boot task polls the clock every 5 s
+
+#define LEGACY_LOG_MAX 16384 // newest bytes of a SPIFFS text log carried over
+
+#define HISTORY_PAGE_SIZE 50
+#define HISTORY_MAX_LIMIT 1000
 
 String wifiSSID="",wifiPASS="";
 String apSSID="ESP8266_PowerLog",apPASS="12345678";
-String logFile="/power_log.txt";
-String lastOnFile="/last_on.txt";
 time_t bootTime=0;
+bool ntpSynced=false;
+uint32_t wifiReconnectAttempts=0;
+uint32_t wifiReconnects=0;
 
-struct LogEntry{
-  String type;
-  time_t timestamp;
-  time_t duration;
-};
+// Cooperative scheduler for loop() housekeeping. interval 0 makes a
+// one-shot task; timings are in microseconds.
+typedef void(*TaskFn)();
 
-struct Stats{
-  time_t todayOff;
-  time_t todayOn;
-  time_t last7Off;
-  time_t last7On;
-  time_t last15Off;
-  time_t last15On;
-  time_t monthOff;
-  time_t monthOn;
-  Stats():todayOff(0),todayOn(0),last7Off(0),last7On(0),last15Off(0),last15On(0),monthOff(0),monthOn(0){}
+struct Task{
+  const char*name;
+  TaskFn fn;
+  uint32_t interval;
+  uint32_t due;
+  bool active;
+  uint32_t runs;
+  uint32_t overruns;
+  uint32_t lastUs;
+  uint32_t worstUs;
+  uint64_t totalUs;
 };
 
-void saveString(int addr,String s,int maxLen){
-  EEPROM.begin(EEPROM_SIZE);
-  for(int i=0;i<maxLen;i++)EEPROM.write(addr+i,(i<s.length())?s[i]:0);
-  EEPROM.commit();
+Task tasks[MAX_TASKS];
+int taskCount=0;
+
+// Registers (or re-arms, when name is already known) a task that first
+// runs delayMs from now. A full table hands over the slot of a one-shot
+// task that has already run. Returns the slot, or -1 if the table is
+// full of pending tasks.
+int scheduleTask(const char*name,TaskFn fn,uint32_t interval,uint32_t delayMs){
+  int slot=-1,spent=-1;
+  for(int i=0;i<taskCount;i++){
+    if(strcmp(tasks[i].name,name)==0){
+      slot=i;
+      break;
+    }
+    if(!tasks[i].interval&&!tasks[i].active&&spent<0)spent=i;
+  }
+  if(slot<0){
+    if(taskCount<MAX_TASKS)slot=taskCount++;
+    else if(spent>=0)slot=spent;
+    else{
+      Serial.println("Task table full, cannot schedule "+String(name));
+      return -1;
+    }
+    memset(&tasks[slot],0,sizeof(Task));
+    tasks[slot].name=name;
+  }
+  Task&t=tasks[slot];
+  t.fn=fn;
+  t.interval=interval;
+  t.due=millis()+delayMs;
+  t.active=true;
+  return slot;
 }
 
-String readString(int addr,int maxLen){
-  EEPROM.begin(EEPROM_SIZE);
-  char buf[maxLen+1];
-  for(int i=0;i<maxLen;i++)buf[i]=EEPROM.read(addr+i);
-  buf[maxLen]=0;
-  return String(buf);
+int scheduleOnce(const char*name,TaskFn fn,uint32_t delayMs){
+  return scheduleTask(name,fn,0,delayMs);
 }
 
-void saveLastReset(time_t t){
-  EEPROM.begin(EEPROM_SIZE);
-  for(int i=0;i<4;i++)EEPROM.write(LAST_RESET_ADDR+i,(t>>(8*i))&0xFF);
-  EEPROM.commit();
+void cancelTask(const char*name){
+  for(int i=0;i<taskCount;i++){
+    if(strcmp(tasks[i].name,name)==0)tasks[i].active=false;
+  }
 }
 
-time_t readLastReset(){
-  EEPROM.begin(EEPROM_SIZE);
-  time_t t=0;
-  for(int i=0;i<4;i++)t|=((time_t)EEPROM.read(LAST_RESET_ADDR+i))<<(8*i);
-  return t;
+// Runs the most overdue task, if any. One task per call keeps the web
+// server serviced between jobs.
+void runScheduler(){
+  uint32_t now=millis();
+  Task*next=nullptr;
+  for(int i=0;i<taskCount;i++){
+    Task&t=tasks[i];
+    if(!t.active||(int32_t)(now-t.due)<0)continue;
+    if(!next||(int32_t)(t.due-next->due)<0)next=&t;
+  }
+  if(!next)return;
+  if(next->interval){
+    next->due+=next->interval;
+    if((int32_t)(now-next->due)>=0)next->due=now+next->interval; // don't replay missed periods
+  }else{
+    next->active=false;
+  }
+  uint32_t start=micros();
+  next->fn();
+  uint32_t elapsed=micros()-start;
+  next->runs++;
+  next->lastUs=elapsed;
+  next->totalUs+=elapsed;
+  if(elapsed>next->worstUs)next->worstUs=elapsed;
+  if(elapsed>TASK_BUDGET_US)next->overruns++;
+}
+
+// Boot runs as a state machine on the scheduler, so the web server is
+// up as soon as the AP is. STA connect and NTP sync are polled, and the
+// OFF/ON entries wait in RAM until the clock is valid; they are then
+// backdated to setup() using millis().
+enum BootState{BOOT_WIFI,BOOT_TIME,BOOT_DONE};
+
+// Boot milestones in millis() since reset, 0 until reached
+struct BootTiming{
+  uint32_t setup;
+  uint32_t serverReady;
+  uint32_t firstResponse;
+  uint32_t wifi;
+  uint32_t timeValid;
+  uint32_t logged;
+};
+
+BootState bootState=BOOT_WIFI;
+BootTiming bootTiming={0,0,0,0,0,0};
+time_t bootLastOn=0;
+bool bootPowerLoss=true;
+uint8_t bootResetReason=REASON_DEFAULT_RST;
+
+void noteResponse(){
+  if(bootTiming.firstResponse)return;
+  bootTiming.firstResponse=millis();
+  Serial.println("First response "+String(bootTiming.firstResponse)+" ms after reset");
 }
 
 void saveConfig(){
@@ -72,14 +170,14 @@ void saveConfig(){
   saveString(WIFI_PASS_ADDR,wifiPASS,64);
   saveString(AP_SSID_ADDR,apSSID,64);
   saveString(AP_PASS_ADDR,apPASS,64);
-  EEPROM.begin(EEPROM_SIZE);
-  EEPROM.write(FLAG_ADDR,1);
-  EEPROM.commit();
+  saveRetention();
+  hal.kv->write(FLAG_ADDR,1);
+  // One flash write for the whole configuration
+  if(!hal.kv->commit())Serial.println(F("⚠ Saving the configuration to EEPROM failed"));
 }
 
 void loadConfig(){
-  EEPROM.begin(EEPROM_SIZE);
-  if(EEPROM.read(FLAG_ADDR)!=1)return;
+  if(hal.kv->read(FLAG_ADDR)!=1)return;
   wifiSSID=readString(WIFI_SSID_ADDR,64);
   wifiPASS=readString(WIFI_PASS_ADDR,64);
   String tmpAP=readString(AP_SSID_ADDR,64);
@@ -95,252 +193,702 @@ void loadConfig(){
   if(tmpPass.length()>0)apPASS=tmpPass;
 }
 
-String getTimeString(time_t t){
-  if(t<=0)return "N/A";
-  struct tm*tmstruct=localtime(&t);
-  char buf[32];
-  strftime(buf,sizeof(buf),"%Y-%m-%d %H:%M:%S",tmstruct);
-  return String(buf);
+// Fine-grained "last alive" stamp in RTC user memory. It is refreshed
+// every few seconds, survives watchdog and software resets, and is lost
+// when power drops.
+struct RtcAlive{
+  uint32_t magic;
+  uint32_t timestamp;
+  uint32_t crc;
+};
+
+bool readRtcAlive(time_t&t){
+  RtcAlive a;
+  if(!ESP.rtcUserMemoryRead(RTC_ALIVE_OFFSET,(uint32_t*)&a,sizeof(a)))return false;
+  if(a.magic!=RTC_ALIVE_MAGIC||a.crc!=crc32Update(0,(const uint8_t*)&a,offsetof(RtcAlive,crc)))return false;
+  t=a.timestamp;
+  return true;
+}
+
+void writeRtcAlive(time_t t){
+  RtcAlive a;
+  a.magic=RTC_ALIVE_MAGIC;
+  a.timestamp=(uint32_t)t;
+  a.crc=crc32Update(0,(const uint8_t*)&a,offsetof(RtcAlive,crc));
+  ESP.rtcUserMemoryWrite(RTC_ALIVE_OFFSET,(uint32_t*)&a,sizeof(a));
+}
+
+// Minimal template engine for markup kept in flash: {0}..{9} are
+// replaced by the matching argument, the rest is copied out of flash
+// through a small stack buffer. Nothing is allocated.
+void printTemplateList(Print&out,PGM_P tpl,const char*const*args,size_t count){
+  char buf[64];
+  size_t n=0;
+  for(;;){
+    char c=pgm_read_byte(tpl++);
+    if(!c)break;
+    char d=pgm_read_byte(tpl);
+    if(c=='{'&&d>='0'&&d<='9'&&pgm_read_byte(tpl+1)=='}'){
+      out.write((const uint8_t*)buf,n);
+      n=0;
+      size_t i=d-'0';
+      if(i<count&&args[i])out.print(args[i]);
+      tpl+=2;
+      continue;
+    }
+    buf[n++]=c;
+    if(n==sizeof(buf)){
+      out.write((const uint8_t*)buf,n);
+      n=0;
+    }
+  }
+  out.write((const uint8_t*)buf,n);
 }
 
-String formatDuration(time_t s){
-  if(s<=0)return "0s";
-  int days=s/86400;s%=86400;
-  int h=s/3600;s%=3600;
-  int m=s/60;int sec=s%60;
-  String result="";
-  if(days>0)result+=String(days)+"d ";
-  if(h>0||days>0)result+=String(h)+"h ";
-  if(m>0||h>0||days>0)result+=String(m)+"m ";
-  result+=String(sec)+"s";
-  return result;
+template<typename...A> void printTemplate(Print&out,PGM_P tpl,const A&...args){
+  const char*list[]={nullptr,(const char*)args...};
+  printTemplateList(out,tpl,list+1,sizeof...(args));
 }
 
-void logEvent(String type,time_t t,time_t dur=0){
-  File f=SPIFFS.open(logFile,"a");
-  if(f){
-    f.println(type+" "+String(t)+" "+String(dur));
+// Number as a template argument, formatted on the stack
+struct NumText{
+  char buf[12];
+  template<typename T> NumText(T v,bool hex=false){
+    if(v<0)snprintf(buf,sizeof(buf),"%ld",(long)v);
+    else snprintf(buf,sizeof(buf),hex?"%lx":"%lu",(unsigned long)v);
+  }
+  operator const char*()const{return buf;}
+};
+
+struct DurationText{
+  char buf[DURATION_TEXT_LEN];
+  DurationText(time_t s){formatDuration(s,buf);}
+  operator const char*()const{return buf;}
+};
+
+struct TimeText{
+  char buf[TIME_TEXT_LEN];
+  TimeText(time_t t){formatTime(t,buf);}
+  operator const char*()const{return buf;}
+};
+
+void navbar(Print&out,const char*active){
+  out.print(F("<nav class='navbar navbar-expand-lg navbar-dark bg-dark'><div class='container-fluid'>"
+  "<a class='navbar-brand' href='/'>⚡ ESP Power</a>"
+  "<button class='navbar-toggler' type='button' data-bs-toggle='collapse' data-bs-target='#navbarNav' "
+  "aria-controls='navbarNav' aria-expanded='false' aria-label='Toggle navigation'>"
+  "<span class='navbar-toggler-icon'></span></button>"
+  "<div class='collapse navbar-collapse' id='navbarNav'><ul class='navbar-nav ms-auto'>"));
+  out.print(F("<li class='nav-item'><a class='nav-link"));
+  if(strcmp(active,"home")==0)out.print(F(" active"));
+  out.print(F("' href='/'>History</a></li>"));
+  out.print(F("<li class='nav-item'><a class='nav-link"));
+  if(strcmp(active,"stats")==0)out.print(F(" active"));
+  out.print(F("' href='/stats'>Stats</a></li>"));
+  out.print(F("<li class='nav-item'><a class='nav-link"));
+  if(strcmp(active,"config")==0)out.print(F(" active"));
+  out.print(F("' href='/config'>Config</a></li>"));
+  out.print(F("</ul></div></div></nav>"));
+}
+
+// Pre-gzipped UI assets in the LittleFS image (built from web/ by
+// scripts/compress_assets.py). etag is the CRC32 of the .gz file, 0 if absent.
+struct StaticAsset{
+  const char*path;
+  const char*contentType;
+  uint32_t etag;
+};
+
+StaticAsset staticAssets[]={
+  {"/app.css","text/css",0},
+  {"/app.js","application/javascript",0},
+};
+
+void loadStaticAssets(){
+  uint8_t buf[128];
+  for(StaticAsset&a:staticAssets){
+    File f=LittleFS.open(String(a.path)+".gz","r");
+    if(!f)continue;
+    uint32_t crc=0;
+    size_t n;
+    while((n=f.read(buf,sizeof(buf)))>0)crc=crc32Update(crc,buf,n);
     f.close();
+    a.etag=crc?crc:1;
   }
 }
 
-void checkMonthlyReset(){
-  time_t now=time(nullptr);
-  time_t lastReset=readLastReset();
-  if(lastReset<=0){
-    saveLastReset(now);
-    return;
+String assetETag(const StaticAsset&a){
+  return "\""+String(a.etag,HEX)+"\"";
+}
+
+// URLs carry the ETag as a version so they can be cached for a year.
+void assetUrl(Print&out,const StaticAsset&a){
+  out.print(a.path);
+  out.print(F("?v="));
+  out.print(a.etag,HEX);
+}
+
+void pageHeader(Print&out,const char*t,const char*active){
+  out.print(F("<!DOCTYPE html><html lang='en'><head><meta charset='UTF-8'>"
+  "<meta name='viewport' content='width=device-width,initial-scale=1.0,maximum-scale=5.0,user-scalable=yes'>"));
+  if(staticAssets[0].etag){
+    out.print(F("<link href='"));
+    assetUrl(out,staticAssets[0]);
+    out.print(F("' rel='stylesheet'>"));
+  }else{
+    // No filesystem image uploaded: fall back to the CDN
+    out.print(F("<link href='https://cdn.jsdelivr.net/npm/bootstrap@5.3.2/dist/css/bootstrap.min.css' rel='stylesheet' integrity='sha384-T3c6CoIi6uLrA9TneNEoa7RxnatzjcDSCmG1MXxSR1GAsXEV/Dwwykc2MPK8M2HN' crossorigin='anonymous'>"
+    "<style>body{padding-bottom:70px;background:#f8f9fa;}"
+    ".card{border-radius:15px;box-shadow:0 3px 8px rgba(0,0,0,0.1);margin-bottom:1rem;}"
+    "footer{position:fixed;bottom:0;width:100%;height:60px;line-height:60px;background:#f1f1f1;text-align:center;}"
+    ".badge-on{background-color:#28a745!important;}.badge-off{background-color:#dc3545!important;}"
+    ".navbar-brand{font-weight:bold;font-size:1.3rem;}"
+    ".table-responsive{overflow-x:auto;-webkit-overflow-scrolling:touch;}"
+    "@media(max-width:768px){body{padding-bottom:80px;}.card{margin:0.5rem;}.container{padding:0.5rem;}}"
+    "</style>"));
   }
-  struct tm*tmNow=localtime(&now);
-  struct tm*tmLast=localtime(&lastReset);
-  if(tmNow->tm_year!=tmLast->tm_year||tmNow->tm_mon!=tmLast->tm_mon){
-    SPIFFS.remove(logFile);
-    SPIFFS.remove(lastOnFile);
-    saveLastReset(now);
-    Serial.println("Monthly reset performed!");
-  }
-}
-
-std::vector<LogEntry>parseLog(){
-  std::vector<LogEntry>entries;
-  File f=SPIFFS.open(logFile,"r");
-  if(!f)return entries;
-  while(f.available()){
-    String line=f.readStringUntil('\n');
-    line.trim();
-    if(line.length()==0)continue;
-    LogEntry e;
-    int sp1=line.indexOf(' ');
-    int sp2=line.indexOf(' ',sp1+1);
-    e.type=line.substring(0,sp1);
-    e.timestamp=line.substring(sp1+1,sp2).toInt();
-    e.duration=(sp2>0)?line.substring(sp2+1).toInt():0;
-    entries.push_back(e);
+  out.print(F("<title>"));
+  out.print(t);
+  out.print(F("</title></head><body>"));
+  navbar(out,active);
+  out.print(F("<div class='container mt-4'>"));
+}
+
+void pageFooter(Print&out){
+  out.print(F("</div><footer class='text-center'>Made with ❤️ by "
+  "<a href='https://github.com/anbuinfosec' target='_blank'>@anbuinfosec</a></footer>"));
+  if(staticAssets[1].etag){
+    out.print(F("<script src='"));
+    assetUrl(out,staticAssets[1]);
+    out.print(F("'></script>"));
+  }else{
+    out.print(F("<script src='https://cdn.jsdelivr.net/npm/bootstrap@5.3.2/dist/js/bootstrap.bundle.min.js' integrity='sha384-C6RzsynM9kWDrMNeT87bh95OGNyZPhcTNXj1NW7RuBCsyN/o0jlpcV8Qyq46cDfL' crossorigin='anonymous'></script>"));
   }
-  f.close();
-  return entries;
+  out.print(F("</body></html>"));
 }
 
-Stats calculateStats(){
-  Stats s;
-  time_t now=time(nullptr);
-  struct tm*tmNow=localtime(&now);
-  time_t todayStart=now-(tmNow->tm_hour*3600+tmNow->tm_min*60+tmNow->tm_sec);
-  time_t day7=now-7*86400;
-  time_t day15=now-15*86400;
-  time_t monthStart=now-(tmNow->tm_mday-1)*86400-(tmNow->tm_hour*3600+tmNow->tm_min*60+tmNow->tm_sec);
-  
-  std::vector<LogEntry>entries=parseLog();
-  for(size_t i=0;i<entries.size();i++){
-    LogEntry e=entries[i];
-    if(e.type=="[OFF]"){
-      if(e.timestamp>=todayStart)s.todayOff+=e.duration;
-      if(e.timestamp>=day7)s.last7Off+=e.duration;
-      if(e.timestamp>=day15)s.last15Off+=e.duration;
-      if(e.timestamp>=monthStart)s.monthOff+=e.duration;
-    }else if(e.type=="[ON]"){
-      if(e.timestamp>=todayStart)s.todayOn+=e.duration;
-      if(e.timestamp>=day7)s.last7On+=e.duration;
-      if(e.timestamp>=day15)s.last15On+=e.duration;
-      if(e.timestamp>=monthStart)s.monthOn+=e.duration;
+// Streams a page as chunked transfer encoding through a fixed buffer, so
+// memory use does not depend on page size.
+class ChunkedWriter:public Print{
+public:
+  ChunkedWriter(const char*contentType="text/html"):len(0){
+    noteResponse();
+    server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    server.send(200,contentType,"");
+  }
+  ~ChunkedWriter(){end();}
+  size_t write(uint8_t c)override{
+    if(len==sizeof(buf))flush();
+    buf[len++]=c;
+    return 1;
+  }
+  size_t write(const uint8_t*data,size_t n)override{
+    size_t left=n;
+    while(left>0){
+      if(len==sizeof(buf))flush();
+      size_t take=std::min(left,sizeof(buf)-len);
+      memcpy(buf+len,data,take);
+      len+=take;
+      data+=take;
+      left-=take;
     }
+    return n;
   }
-  return s;
+  void flush()override{
+    if(len==0)return;
+    if(tee)tee->write((const uint8_t*)buf,len);
+    server.sendContent(buf,len);
+    countResponseBytes(len);
+    len=0;
+  }
+  void end(){
+    if(finished)return;
+    flush();
+    server.sendContent("");
+    finished=true;
+  }
+  Print*tee=nullptr; // also gets every chunk sent, e.g. a CacheCapture
+private:
+  char buf[512];
+  size_t len;
+  bool finished=false;
+};
+
+// Reads the from/to/limit/offset request arguments into q and positions
+// reader on the selected page; without offset the newest page is returned.
+void resolveLogQueryArgs(LogReader&reader,LogQuery&q,size_t defaultLimit,size_t maxLimit){
+  q.from=server.hasArg("from")?(time_t)server.arg("from").toInt():0;
+  q.to=server.hasArg("to")?(time_t)server.arg("to").toInt():0;
+  long limit=server.hasArg("limit")?server.arg("limit").toInt():defaultLimit;
+  q.limit=(limit<=0)?defaultLimit:std::min((size_t)limit,maxLimit);
+  resolveLogQuery(reader,q,server.hasArg("offset")?server.arg("offset").toInt():-1);
 }
 
-String navbar(String active){
-  String nav="<nav class='navbar navbar-expand-lg navbar-dark bg-dark'><div class='container-fluid'>"
-  "<a class='navbar-brand' href='/'>⚡ ESP Power</a>"
-  "<button class='navbar-toggler' type='button' data-bs-toggle='collapse' data-bs-target='#navbarNav' "
-  "aria-controls='navbarNav' aria-expanded='false' aria-label='Toggle navigation'>"
-  "<span class='navbar-toggler-icon'></span></button>"
-  "<div class='collapse navbar-collapse' id='navbarNav'><ul class='navbar-nav ms-auto'>";
-  nav+="<li class='nav-item'><a class='nav-link";
-  if(active=="home")nav+=" active";
-  nav+="' href='/'>History</a></li>";
-  nav+="<li class='nav-item'><a class='nav-link";
-  if(active=="stats")nav+=" active";
-  nav+="' href='/stats'>Stats</a></li>";
-  nav+="<li class='nav-item'><a class='nav-link";
-  if(active=="config")nav+=" active";
-  nav+="' href='/config'>Config</a></li>";
-  nav+="</ul></div></div></nav>";
-  return nav;
-}
-
-String pageHeader(String t,String active){
-  String html="<!DOCTYPE html><html lang='en'><head><meta charset='UTF-8'>"
-  "<meta name='viewport' content='width=device-width,initial-scale=1.0,maximum-scale=5.0,user-scalable=yes'>"
-  "<link href='https://cdn.jsdelivr.net/npm/bootstrap@5.3.2/dist/css/bootstrap.min.css' rel='stylesheet' integrity='sha384-T3c6CoIi6uLrA9TneNEoa7RxnatzjcDSCmG1MXxSR1GAsXEV/Dwwykc2MPK8M2HN' crossorigin='anonymous'>"
-  "<title>"+t+"</title><style>body{padding-bottom:70px;background:#f8f9fa;}"
-  ".card{border-radius:15px;box-shadow:0 3px 8px rgba(0,0,0,0.1);margin-bottom:1rem;}"
-  "footer{position:fixed;bottom:0;width:100%;height:60px;line-height:60px;background:#f1f1f1;text-align:center;}"
-  ".badge-on{background-color:#28a745!important;}.badge-off{background-color:#dc3545!important;}"
-  ".navbar-brand{font-weight:bold;font-size:1.3rem;}"
-  ".table-responsive{overflow-x:auto;-webkit-overflow-scrolling:touch;}"
-  "@media(max-width:768px){body{padding-bottom:80px;}.card{margin:0.5rem;}.container{padding:0.5rem;}}"
-  "</style></head><body>"+navbar(active)+"<div class='container mt-4'>";
-  return html;
-}
-
-String pageFooter(){
-  return "</div><footer class='text-center'>Made with ❤️ by "
-  "<a href='https://github.com/anbuinfosec' target='_blank'>@anbuinfosec</a></footer>"
-  "<script src='https://cdn.jsdelivr.net/npm/bootstrap@5.3.2/dist/js/bootstrap.bundle.min.js' integrity='sha384-C6RzsynM9kWDrMNeT87bh95OGNyZPhcTNXj1NW7RuBCsyN/o0jlpcV8Qyq46cDfL' crossorigin='anonymous'></script></body></html>";
-}
-
-String getHTML(){
-  std::vector<LogEntry>entries=parseLog();
+void historyPageLink(Print&out,const LogQuery&q,size_t offset,const char*label){
+  out.print(F("<a class='btn btn-outline-secondary btn-sm me-2' href='/?offset="));
+  out.print(offset);
+  out.print(F("&limit="));
+  out.print(q.limit);
+  if(q.from>0){
+    out.print(F("&from="));
+    out.print((unsigned long)q.from);
+  }
+  if(q.to>0){
+    out.print(F("&to="));
+    out.print((unsigned long)q.to);
+  }
+  out.print(F("'>"));
+  out.print(label);
+  out.print(F("</a>"));
+}
+
+void renderHistory(Print&out){
   Stats s=calculateStats();
   time_t now=time(nullptr);
   
-  String html=pageHeader("Power History","home");
-  html+="<div class='card p-4 mb-3'><h3>⚡ Power History</h3>";
-  html+="<div class='mb-3'><a href='/clear' class='btn btn-danger btn-sm'>Clear Logs</a></div>";
+  pageHeader(out,"Power History","home");
+  out.print(F("<div class='card p-4 mb-3'><h3>⚡ Power History</h3>"));
+  out.print(F("<div class='mb-3'><a href='/clear' class='btn btn-danger btn-sm'>Clear Logs</a></div>"));
   
-  html+="<div class='table-responsive'><table class='table table-bordered table-striped'><thead class='table-dark'>"
-  "<tr><th>#</th><th>Event</th><th>Time</th><th>Duration</th></tr></thead><tbody>";
+  LogReader reader;
+  LogQuery q;
+  LogRecord r;
+  bool opened=reader.open();
+  if(opened)resolveLogQueryArgs(reader,q,HISTORY_PAGE_SIZE,HISTORY_MAX_LIMIT);
+  // Live log events are appended only to the newest page
+  bool newest=q.to==0&&q.offset+q.limit>=q.matched;
+  out.print(F("<div class='table-responsive'><table class='table table-bordered table-striped'><thead class='table-dark'>"
+  "<tr><th>#</th><th>Event</th><th>Time</th><th>Duration</th></tr></thead>"));
+  out.print(newest?F("<tbody data-live-log>"):F("<tbody>"));
   
-  for(size_t i=0;i<entries.size();i++){
-    LogEntry e=entries[i];
-    String badge=(e.type=="[ON]")?"<span class='badge badge-on'>ON</span>":"<span class='badge badge-off'>OFF</span>";
-    String dur=(e.duration>0)?formatDuration(e.duration):"-";
-    html+="<tr><td>"+String(i+1)+"</td><td>"+badge+"</td><td>"+getTimeString(e.timestamp)+"</td><td>"+dur+"</td></tr>";
+  if(opened){
+    while(reader.next(r)){
+      out.print(F("<tr><td>"));
+      out.print(reader.index);
+      out.print(F("</td><td>"));
+      if(EV_KIND(r.type)==EV_ON)out.print(F("<span class='badge badge-on'>ON</span>"));
+      else if(EV_KIND(r.type)==EV_RESTART)out.print(F("<span class='badge bg-secondary'>RESTART</span>"));
+      else if(EV_KIND(r.type)==EV_SAG)out.print(F("<span class='badge bg-warning text-dark'>SAG</span>"));
+      else if(EV_KIND(r.type)==EV_SWELL)out.print(F("<span class='badge bg-info text-dark'>SWELL</span>"));
+      else out.print(F("<span class='badge badge-off'>OFF</span>"));
+      if(EV_HAS_CAUSE(r.type)&&EV_CAUSE(r.type)!=REASON_DEFAULT_RST){
+        out.print(F(" <small class='text-muted'>"));
+        out.print(resetCauseName(EV_CAUSE(r.type)));
+        out.print(F("</small>"));
+      }
+      out.print(F("</td><td>"));
+      printTime(out,r.timestamp);
+      out.print(F("</td><td>"));
+      if(r.duration>0)printDuration(out,r.duration);
+      else out.print(F("-"));
+      out.print(F("</td></tr>"));
+    }
+    reader.close();
   }
-  html+="</tbody></table></div></div>";
-  
-  html+="<div class='card p-4 mb-3'><h4>📊 Power Statistics</h4><div class='table-responsive'><table class='table table-sm'>";
-  html+="<tr><th>Period</th><th>Power OFF Time</th><th>Power ON Time</th></tr>";
-  html+="<tr><td><strong>Today</strong></td><td class='text-danger'>"+formatDuration(s.todayOff)+"</td><td class='text-success'>"+formatDuration(now-bootTime)+"</td></tr>";
-  html+="<tr><td><strong>Last 7 Days</strong></td><td class='text-danger'>"+formatDuration(s.last7Off)+"</td><td class='text-success'>"+formatDuration(s.last7On)+"</td></tr>";
-  html+="<tr><td><strong>Last 15 Days</strong></td><td class='text-danger'>"+formatDuration(s.last15Off)+"</td><td class='text-success'>"+formatDuration(s.last15On)+"</td></tr>";
-  html+="<tr><td><strong>This Month</strong></td><td class='text-danger'>"+formatDuration(s.monthOff)+"</td><td class='text-success'>"+formatDuration(s.monthOn)+"</td></tr>";
-  html+="</table></div><small class='text-muted'>Current uptime: "+formatDuration(now-bootTime)+"</small></div>";
+  out.print(F("</tbody></table></div>"));
+  if(q.matched>0){
+    out.print(F("<div class='d-flex align-items-center'>"));
+    if(q.offset>0)historyPageLink(out,q,(q.offset>q.limit)?q.offset-q.limit:0,"&laquo; Older");
+    if(q.offset+q.limit<q.matched)historyPageLink(out,q,q.offset+q.limit,"Newer &raquo;");
+    out.print(F("<small class='text-muted ms-auto'>"));
+    out.print(q.offset+1);
+    out.print(F("-"));
+    out.print(q.offset+(q.last-q.first));
+    out.print(F(" of "));
+    out.print(q.matched);
+    out.print(F("</small></div>"));
+  }
+  out.print(F("</div>"));
   
-  html+="<p class='text-muted text-center'><small>Updated: "+getTimeString(now)+"</small></p>";
-  html+=pageFooter();
-  return html;
+  out.print(F("<div class='card p-4 mb-3'><h4>📊 Power Statistics</h4><div class='table-responsive'><table class='table table-sm'>"));
+  out.print(F("<tr><th>Period</th><th>Power OFF Time</th><th>Power ON Time</th></tr>"));
+  static const char periodRow[] PROGMEM="<tr><td><strong>{0}</strong></td><td class='text-danger'>{1}</td><td class='text-success'>{2}</td></tr>";
+  // ON today is the uptime, kept current by app.js so the page can be cached
+  printTemplate(out,PSTR("<tr><td><strong>Today</strong></td><td class='text-danger'>{0}</td><td class='text-success' data-live='uptime'>{1}</td></tr>"),
+    DurationText(s.todayOff),DurationText(now-bootTime));
+  printTemplate(out,periodRow,"Last 7 Days",DurationText(s.last7Off),DurationText(s.last7On));
+  printTemplate(out,periodRow,"Last 15 Days",DurationText(s.last15Off),DurationText(s.last15On));
+  printTemplate(out,periodRow,"This Month",DurationText(s.monthOff),DurationText(s.monthOn));
+  printTemplate(out,PSTR("</table></div><small class='text-muted'>Current uptime: <span data-live='uptime'>{0}</span></small></div>"
+  "<p class='text-muted text-center'><small>Updated: <span data-live='time'>{1}</span></small></p>"),DurationText(now-bootTime),TimeText(now));
+  pageFooter(out);
+}
+
+// One name/value row; the value is a flash template and its arguments
+template<typename...A> void statsRow(Print&out,const __FlashStringHelper*name,PGM_P value,const A&...args){
+  out.print(F("<tr><th>"));
+  out.print(name);
+  out.print(F("</th><td>"));
+  printTemplate(out,value,args...);
+  out.print(F("</td></tr>"));
+}
+
+void statsRow(Print&out,const __FlashStringHelper*name,const String&value){
+  statsRow(out,name,PSTR("{0}"),value.c_str());
+}
+
+void renderLogJson(Print&out){
+  LogReader reader;
+  LogQuery q;
+  if(reader.open())resolveLogQueryArgs(reader,q,SIZE_MAX,SIZE_MAX);
+  writeLogJson(out,reader,q);
 }
 
-String statsPage(){
+void renderLogCsv(Print&out){
+  LogReader reader;
+  LogQuery q;
+  if(reader.open())resolveLogQueryArgs(reader,q,SIZE_MAX,SIZE_MAX);
+  writeLogCsv(out,reader);
+}
+
+void renderStatsJson(Print&out){
   Stats s=calculateStats();
-  String html=pageHeader("ESP Stats","stats");
-  html+="<div class='card p-4 mb-3'><h3>📡 Device Statistics</h3>";
-  html+="<div class='table-responsive'><table class='table table-bordered table-striped mt-3'>";
-  html+="<tr><th>Chip ID</th><td>"+String(ESP.getChipId(),HEX)+"</td></tr>";
-  html+="<tr><th>Flash Chip ID</th><td>"+String(ESP.getFlashChipId(),HEX)+"</td></tr>";
-  html+="<tr><th>Flash Size</th><td>"+String(ESP.getFlashChipSize()/1024)+" KB</td></tr>";
-  html+="<tr><th>Real Flash Size</th><td>"+String(ESP.getFlashChipRealSize()/1024)+" KB</td></tr>";
-  html+="<tr><th>Free Heap</th><td>"+String(ESP.getFreeHeap())+" bytes</td></tr>";
-  html+="<tr><th>CPU Frequency</th><td>"+String(ESP.getCpuFreqMHz())+" MHz</td></tr>";
-  html+="<tr><th>SDK Version</th><td>"+String(ESP.getSdkVersion())+"</td></tr>";
-  html+="<tr><th>Boot Version</th><td>"+String(ESP.getBootVersion())+"</td></tr>";
-  html+="<tr><th>Boot Mode</th><td>"+String(ESP.getBootMode())+"</td></tr>";
-  html+="<tr><th>Sketch Size</th><td>"+String(ESP.getSketchSize())+" bytes</td></tr>";
-  html+="<tr><th>Free Sketch Space</th><td>"+String(ESP.getFreeSketchSpace())+" bytes</td></tr>";
-  html+="<tr><th>Reset Reason</th><td>"+ESP.getResetReason()+"</td></tr>";
-  html+="<tr><th>Reset Info</th><td>"+ESP.getResetInfo()+"</td></tr>";
+  time_t now=time(nullptr);
+  FSInfo fs;
+  LittleFS.info(fs);
+  out.print(F("{\"time\":"));
+  out.print((unsigned long)now);
+  out.print(F(",\"bootTime\":"));
+  out.print((unsigned long)bootTime);
+  out.print(F(",\"uptime\":"));
+  out.print(millis()/1000);
+  out.print(F(",\"power\":{\"todayOff\":"));
+  out.print((unsigned long)s.todayOff);
+  out.print(F(",\"todayOn\":"));
+  out.print((unsigned long)s.todayOn);
+  out.print(F(",\"last7Off\":"));
+  out.print((unsigned long)s.last7Off);
+  out.print(F(",\"last7On\":"));
+  out.print((unsigned long)s.last7On);
+  out.print(F(",\"last15Off\":"));
+  out.print((unsigned long)s.last15Off);
+  out.print(F(",\"last15On\":"));
+  out.print((unsigned long)s.last15On);
+  out.print(F(",\"monthOff\":"));
+  out.print((unsigned long)s.monthOff);
+  out.print(F(",\"monthOn\":"));
+  out.print((unsigned long)s.monthOn);
+  out.print(F("},\"outages\":"));
+  writeOutageJson(out);
+  out.print(F(",\"freeHeap\":"));
+  out.print(ESP.getFreeHeap());
+  out.print(F(",\"flashSize\":"));
+  out.print(ESP.getFlashChipSize());
+  out.print(F(",\"realFlashSize\":"));
+  out.print(ESP.getFlashChipRealSize());
+  out.print(F(",\"sketchSize\":"));
+  out.print(ESP.getSketchSize());
+  out.print(F(",\"freeSketchSpace\":"));
+  out.print(ESP.getFreeSketchSpace());
+  out.print(F(",\"fsTotal\":"));
+  out.print(fs.totalBytes);
+  out.print(F(",\"fsUsed\":"));
+  out.print(fs.usedBytes);
+  out.print(F(",\"logSegments\":"));
+  out.print(segments.size());
+  out.print(F(",\"logBytes\":"));
+  out.print(logBytes());
+  out.print(F(",\"archiveBytes\":"));
+  out.print(archiveBytes());
+  out.print(F(",\"wifiConnected\":"));
+  out.print((WiFi.status()==WL_CONNECTED)?"true":"false");
+  out.print(F(",\"rssi\":"));
+  out.print(WiFi.RSSI());
+  out.print(F(",\"resetReason\":\""));
+  out.print(ESP.getResetReason());
+  out.print(F("\",\"boot\":{\"setup\":"));
+  out.print(bootTiming.setup);
+  out.print(F(",\"serverReady\":"));
+  out.print(bootTiming.serverReady);
+  out.print(F(",\"firstResponse\":"));
+  out.print(bootTiming.firstResponse);
+  out.print(F(",\"wifi\":"));
+  out.print(bootTiming.wifi);
+  out.print(F(",\"timeValid\":"));
+  out.print(bootTiming.timeValid);
+  out.print(F(",\"logged\":"));
+  out.print(bootTiming.logged);
+  out.print(F("}}"));
+}
+
+// Prometheus text format for /metrics
+void renderMetrics(Print&out){
+  writeRouteMetrics(out);
+  metricHeader(out,F("esp_loop_duration_seconds"),"histogram",F("Time per loop() pass, including request handling and scheduled tasks."));
+  metricHistogram(out,F("esp_loop_duration_seconds"),"",loopLatency);
+  
+  char labels[40];
+  metricHeader(out,F("esp_task_runs_total"),"counter",F("Scheduled task runs."));
+  for(int i=0;i<taskCount;i++){
+    snprintf(labels,sizeof(labels),"task=\"%s\"",tasks[i].name);
+    metricValue(out,F("esp_task_runs_total"),labels,tasks[i].runs);
+  }
+  metricHeader(out,F("esp_task_overruns_total"),"counter",F("Task runs over the 10 ms budget."));
+  for(int i=0;i<taskCount;i++){
+    snprintf(labels,sizeof(labels),"task=\"%s\"",tasks[i].name);
+    metricValue(out,F("esp_task_overruns_total"),labels,tasks[i].overruns);
+  }
+  metricHeader(out,F("esp_task_duration_seconds_total"),"counter",F("Total time spent in each task."));
+  for(int i=0;i<taskCount;i++){
+    snprintf(labels,sizeof(labels),"task=\"%s\"",tasks[i].name);
+    metricSeconds(out,F("esp_task_duration_seconds_total"),labels,tasks[i].totalUs);
+  }
+  
+  metricHeader(out,F("esp_heap_free_bytes"),"gauge",F("Free heap."));
+  metricValue(out,F("esp_heap_free_bytes"),"",ESP.getFreeHeap());
+  metricHeader(out,F("esp_heap_max_free_block_bytes"),"gauge",F("Largest allocatable block."));
+  metricValue(out,F("esp_heap_max_free_block_bytes"),"",ESP.getMaxFreeBlockSize());
+  metricHeader(out,F("esp_heap_fragmentation_percent"),"gauge",F("Heap fragmentation (0 = none)."));
+  metricValue(out,F("esp_heap_fragmentation_percent"),"",ESP.getHeapFragmentation());
+  
+  bool connected=WiFi.status()==WL_CONNECTED;
+  metricHeader(out,F("esp_wifi_connected"),"gauge",F("1 while the station is connected."));
+  metricValue(out,F("esp_wifi_connected"),"",connected);
+  metricHeader(out,F("esp_wifi_rssi_dbm"),"gauge",F("Station signal strength (0 when disconnected)."));
+  out.print(F("esp_wifi_rssi_dbm "));
+  out.print(connected?WiFi.RSSI():0);
+  out.print('\n');
+  metricHeader(out,F("esp_wifi_reconnect_attempts_total"),"counter",F("Station reconnect attempts after a disconnect."));
+  metricValue(out,F("esp_wifi_reconnect_attempts_total"),"",wifiReconnectAttempts);
+  metricHeader(out,F("esp_wifi_reconnects_total"),"counter",F("Station reconnects that succeeded."));
+  metricValue(out,F("esp_wifi_reconnects_total"),"",wifiReconnects);
+  metricHeader(out,F("esp_wifi_ap_clients"),"gauge",F("Stations connected to the AP."));
+  metricValue(out,F("esp_wifi_ap_clients"),"",WiFi.softAPgetStationNum());
+  
+  metricHeader(out,F("esp_sse_clients"),"gauge",F("Open /events streams."));
+  metricValue(out,F("esp_sse_clients"),"",eventClientCount());
+  metricHeader(out,F("esp_sse_events_sent_total"),"counter",F("Events written to /events streams."));
+  metricValue(out,F("esp_sse_events_sent_total"),"",eventsSent());
+  metricHeader(out,F("esp_sse_events_dropped_total"),"counter",F("Events dropped for slow /events clients."));
+  metricValue(out,F("esp_sse_events_dropped_total"),"",eventsDropped());
+  
+  metricHeader(out,F("esp_log_records"),"gauge",F("Retained power log records."));
+  metricValue(out,F("esp_log_records"),"",logTotal()-logFirst());
+  metricHeader(out,F("esp_log_bytes"),"gauge",F("Power log size on flash."));
+  metricValue(out,F("esp_log_bytes"),"",logBytes());
+  metricHeader(out,F("esp_archive_bytes"),"gauge",F("Compressed archive of evicted log records on flash."));
+  metricValue(out,F("esp_archive_bytes"),"",archiveBytes());
+  metricHeader(out,F("esp_cache_responses_total"),"counter",F("Cacheable responses by how they were answered."));
+  metricValue(out,F("esp_cache_responses_total"),"result=\"hit\"",cacheHits());
+  metricValue(out,F("esp_cache_responses_total"),"result=\"miss\"",cacheMisses());
+  metricValue(out,F("esp_cache_responses_total"),"result=\"not_modified\"",cacheNotModified());
+  metricHeader(out,F("esp_cache_ram_bytes"),"gauge",F("Cached response bodies held in RAM."));
+  metricValue(out,F("esp_cache_ram_bytes"),"",cacheRamBytes());
+#if SUPPLY_SENSE
+  const SupplyStatus&supply=supplyStatus();
+  SupplySecond sec;
+  if(supplySecond(0,sec)){
+    metricHeader(out,F("esp_supply_millivolts"),"gauge",F("Supply voltage over the last complete second."));
+    metricValue(out,F("esp_supply_millivolts"),"stat=\"min\"",sec.minMv);
+    metricValue(out,F("esp_supply_millivolts"),"stat=\"mean\"",sec.meanMv);
+    metricValue(out,F("esp_supply_millivolts"),"stat=\"max\"",sec.maxMv);
+  }
+  metricHeader(out,F("esp_supply_events_total"),"counter",F("Supply excursions that did not reset the chip."));
+  metricValue(out,F("esp_supply_events_total"),"type=\"sag\"",supply.sags);
+  metricValue(out,F("esp_supply_events_total"),"type=\"swell\"",supply.swells);
+  metricHeader(out,F("esp_supply_samples_dropped_total"),"counter",F("Supply samples lost to a full ring buffer."));
+  metricValue(out,F("esp_supply_samples_dropped_total"),"",supply.overruns);
+  metricHeader(out,F("esp_supply_samples_missed_total"),"counter",F("Supply sample periods skipped while loop() did not yield."));
+  metricValue(out,F("esp_supply_samples_missed_total"),"",supply.missed);
+#endif
+  metricHeader(out,F("esp_uptime_seconds"),"gauge",F("Time since reset."));
+  metricValue(out,F("esp_uptime_seconds"),"",millis()/1000);
+  metricHeader(out,F("esp_boot_first_response_milliseconds"),"gauge",F("Time from reset to the first HTTP response (0 until then)."));
+  metricValue(out,F("esp_boot_first_response_milliseconds"),"",bootTiming.firstResponse);
+}
+
+void bootMilestoneRow(Print&out,const __FlashStringHelper*name,uint32_t ms){
+  if(ms)statsRow(out,name,PSTR("{0} ms"),NumText(ms));
+  else statsRow(out,name,PSTR("pending"));
+}
+
+// Outage summary and a day-of-week by hour heatmap of outage starts,
+// shaded relative to the busiest hour
+void renderOutageStats(Print&out){
+  const OutageStats&o=calculateOutageStats();
+  out.print(F("<h5 class='mt-4'>Outage Analytics</h5><div class='table-responsive'><table class='table table-sm'>"));
+  statsRow(out,F("Outages"),PSTR("{0} ({1} restarts)"),NumText(o.outages),NumText(o.restarts));
+  if(o.outages){
+    statsRow(out,F("Mean / Median"),PSTR("{0} / {1}"),DurationText(o.meanOff()),DurationText(o.percentile(50)));
+    statsRow(out,F("95th Percentile"),PSTR("{0}"),DurationText(o.percentile(95)));
+    statsRow(out,F("Longest"),PSTR("{0} at {1}"),DurationText(o.maxOff),TimeText(o.longestAt));
+    if(o.mtbf())statsRow(out,F("Mean Time Between Outages"),PSTR("{0}"),DurationText(o.mtbf()));
+    else statsRow(out,F("Mean Time Between Outages"),PSTR("-"));
+  }
+  out.print(F("</table></div>"));
+  if(!o.outages)return;
   
+  uint16_t peak=1;
+  for(int d=0;d<OUTAGE_DAYS;d++){
+    for(int h=0;h<OUTAGE_HOURS;h++)peak=std::max(peak,o.heatmap[d][h]);
+  }
+  static const char dayNames[OUTAGE_DAYS][4] PROGMEM={"Sun","Mon","Tue","Wed","Thu","Fri","Sat"};
+  out.print(F("<div class='table-responsive'><table class='table table-sm table-bordered text-center small'><tr><th></th>"));
+  for(int h=0;h<OUTAGE_HOURS;h++){
+    out.print(F("<th>"));
+    out.print(h);
+    out.print(F("</th>"));
+  }
+  out.print(F("</tr>"));
+  for(int d=0;d<OUTAGE_DAYS;d++){
+    out.print(F("<tr><th>"));
+    out.print(FPSTR(dayNames[d]));
+    out.print(F("</th>"));
+    for(int h=0;h<OUTAGE_HOURS;h++){
+      uint16_t n=o.heatmap[d][h];
+      if(!n){
+        out.print(F("<td></td>"));
+        continue;
+      }
+      out.print(F("<td style='background:rgba(220,53,69,"));
+      out.print((float)n/peak,2);
+      out.print(F(")'>"));
+      out.print(n);
+      out.print(F("</td>"));
+    }
+    out.print(F("</tr>"));
+  }
+  out.print(F("</table></div>"));
+}
+
+// Rows that change without the log changing. The cached /stats page
+// fetches them from /stats/live when app.js is there to do it.
+void renderStatsLive(Print&out){
+  out.print(F("<div class='table-responsive'><table class='table table-bordered table-striped'>"));
+  statsRow(out,F("Free Heap"),PSTR("<span data-live='heap'>{0}</span> bytes"),NumText(ESP.getFreeHeap()));
+  statsRow(out,F("Largest Free Block"),PSTR("{0} bytes ({1}% fragmented)"),NumText(ESP.getMaxFreeBlockSize()),NumText(ESP.getHeapFragmentation()));
   FSInfo fs;
-  SPIFFS.info(fs);
-  html+="<tr><th>SPIFFS Total</th><td>"+String(fs.totalBytes)+" bytes</td></tr>";
-  html+="<tr><th>SPIFFS Used</th><td>"+String(fs.usedBytes)+" bytes</td></tr>";
-  html+="<tr><th>SPIFFS Free</th><td>"+String(fs.totalBytes-fs.usedBytes)+" bytes</td></tr>";
+  LittleFS.info(fs);
+  statsRow(out,F("LittleFS Used"),PSTR("{0} bytes"),NumText(fs.usedBytes));
+  statsRow(out,F("LittleFS Free"),PSTR("{0} bytes"),NumText(fs.totalBytes-fs.usedBytes));
+#if SUPPLY_SENSE
+  const SupplyStatus&supply=supplyStatus();
+  SupplySecond sec;
+  if(supplySecond(0,sec))statsRow(out,F("Supply Voltage"),PSTR("{0} mV (min {1}, max {2} over the last second)"),NumText(sec.meanMv),NumText(sec.minMv),NumText(sec.maxMv));
+  statsRow(out,F("Supply Events"),PSTR("{0} sags, {1} swells, {2} samples dropped, {3} missed"),NumText(supply.sags),NumText(supply.swells),NumText(supply.overruns),NumText(supply.missed));
+#endif
   
-  html+="<tr><th>WiFi Mode</th><td>";
   WiFiMode_t mode=WiFi.getMode();
-  if(mode==WIFI_AP_STA)html+="Repeater (AP + STA)";
-  else if(mode==WIFI_AP)html+="Access Point";
-  else if(mode==WIFI_STA)html+="Station";
-  else html+="Off";
-  html+="</td></tr>";
-  
-  html+="<tr><th>AP SSID</th><td>"+String(apSSID)+"</td></tr>";
-  html+="<tr><th>AP IP</th><td>"+WiFi.softAPIP().toString()+"</td></tr>";
-  html+="<tr><th>AP MAC</th><td>"+WiFi.softAPmacAddress()+"</td></tr>";
-  html+="<tr><th>AP Clients</th><td>"+String(WiFi.softAPgetStationNum())+"</td></tr>";
-  
-  html+="<tr><th>WiFi Status</th><td>";
-  html+=(WiFi.status()==WL_CONNECTED)?"<span class='badge bg-success'>Connected</span>":"<span class='badge bg-secondary'>Disconnected</span>";
-  html+="</td></tr>";
+  if(mode==WIFI_AP_STA)statsRow(out,F("WiFi Mode"),PSTR("Repeater (AP + STA)"));
+  else if(mode==WIFI_AP)statsRow(out,F("WiFi Mode"),PSTR("Access Point"));
+  else if(mode==WIFI_STA)statsRow(out,F("WiFi Mode"),PSTR("Station"));
+  else statsRow(out,F("WiFi Mode"),PSTR("Off"));
+  
+  statsRow(out,F("AP SSID"),apSSID);
+  statsRow(out,F("AP IP"),WiFi.softAPIP().toString());
+  statsRow(out,F("AP MAC"),WiFi.softAPmacAddress());
+  statsRow(out,F("AP Clients"),PSTR("{0}"),NumText(WiFi.softAPgetStationNum()));
+  
   if(WiFi.status()==WL_CONNECTED){
-    html+="<tr><th>Connected To</th><td>"+WiFi.SSID()+"</td></tr>";
-    html+="<tr><th>Station IP</th><td>"+WiFi.localIP().toString()+"</td></tr>";
-    html+="<tr><th>Gateway</th><td>"+WiFi.gatewayIP().toString()+"</td></tr>";
-    html+="<tr><th>Subnet Mask</th><td>"+WiFi.subnetMask().toString()+"</td></tr>";
-    html+="<tr><th>DNS</th><td>"+WiFi.dnsIP().toString()+"</td></tr>";
-    html+="<tr><th>Station MAC</th><td>"+WiFi.macAddress()+"</td></tr>";
-    html+="<tr><th>RSSI</th><td>"+String(WiFi.RSSI())+" dBm</td></tr>";
-  }
-  
-  html+="<tr><th>Current Time</th><td>"+getTimeString(time(nullptr))+"</td></tr>";
-  html+="<tr><th>Uptime</th><td>"+formatDuration(millis()/1000)+"</td></tr>";
-  html+="</table></div>";
-  
-  html+="<h5 class='mt-4'>Power Statistics</h5><ul class='list-group'>";
-  html+="<li class='list-group-item'>Today: <span class='float-end'><strong class='text-danger'>OFF: "+formatDuration(s.todayOff)+"</strong> | <strong class='text-success'>ON: "+formatDuration(time(nullptr)-bootTime)+"</strong></span></li>";
-  html+="<li class='list-group-item'>Last 7 days: <span class='float-end'><strong class='text-danger'>OFF: "+formatDuration(s.last7Off)+"</strong> | <strong class='text-success'>ON: "+formatDuration(s.last7On)+"</strong></span></li>";
-  html+="<li class='list-group-item'>Last 15 days: <span class='float-end'><strong class='text-danger'>OFF: "+formatDuration(s.last15Off)+"</strong> | <strong class='text-success'>ON: "+formatDuration(s.last15On)+"</strong></span></li>";
-  html+="<li class='list-group-item'>Last Month: <span class='float-end'><strong class='text-danger'>OFF: "+formatDuration(s.monthOff)+"</strong> | <strong class='text-success'>ON: "+formatDuration(s.monthOn)+"</strong></span></li>";
-  html+="</ul><p class='mt-3 text-muted'><small>Data resets automatically after one month.</small></p>";
-  html+="</div>"+pageFooter();
-  return html;
-}
-
-String configPage(){
-  String html=pageHeader("Configuration","config");
-  html+="<div class='card p-4'><h3>⚙️ Wi-Fi & AP Configuration</h3>";
-  html+="<form action='/save' method='POST' class='mt-3'>";
-  html+="<div class='mb-3'><label class='form-label'>Wi-Fi SSID:</label>"
-  "<input class='form-control' name='ssid' value='"+wifiSSID+"' placeholder='Your WiFi Network'></div>";
-  html+="<div class='mb-3'><label class='form-label'>Wi-Fi Password:</label>"
-  "<input class='form-control' type='password' name='pass' value='"+wifiPASS+"' placeholder='WiFi Password'></div>";
-  html+="<div class='mb-3'><label class='form-label'>Fallback AP SSID:</label>"
-  "<input class='form-control' name='apssid' value='"+apSSID+"' placeholder='ESP8266_PowerLog'></div>";
-  html+="<div class='mb-3'><label class='form-label'>Fallback AP Password:</label>"
-  "<input class='form-control' type='password' name='appass' value='"+apPASS+"' placeholder='Min 8 characters' minlength='8'></div>";
-  html+="<button class='btn btn-success w-100 btn-lg'>💾 Save & Restart</button></form></div>"+pageFooter();
-  return html;
+    statsRow(out,F("WiFi Status"),PSTR("<span class='badge bg-success' data-live='wifi'>Connected</span>"));
+    statsRow(out,F("Connected To"),WiFi.SSID());
+    statsRow(out,F("Station IP"),WiFi.localIP().toString());
+    statsRow(out,F("Gateway"),WiFi.gatewayIP().toString());
+    statsRow(out,F("Subnet Mask"),WiFi.subnetMask().toString());
+    statsRow(out,F("DNS"),WiFi.dnsIP().toString());
+    statsRow(out,F("Station MAC"),WiFi.macAddress());
+    statsRow(out,F("RSSI"),PSTR("<span data-live='rssi'>{0}</span> dBm"),NumText(WiFi.RSSI()));
+  }else{
+    statsRow(out,F("WiFi Status"),PSTR("<span class='badge bg-secondary' data-live='wifi'>Disconnected</span>"));
+  }
+  
+  bootMilestoneRow(out,F("Web Server Ready"),bootTiming.serverReady);
+  bootMilestoneRow(out,F("First Response"),bootTiming.firstResponse);
+  bootMilestoneRow(out,F("WiFi Connected"),bootTiming.wifi);
+  bootMilestoneRow(out,F("Time Valid"),bootTiming.timeValid);
+  bootMilestoneRow(out,F("Boot Logged"),bootTiming.logged);
+  statsRow(out,F("Current Time"),PSTR("<span data-live='time'>{0}</span>"),TimeText(time(nullptr)));
+  statsRow(out,F("Uptime"),PSTR("<span data-live='uptime'>{0}</span>"),DurationText(millis()/1000));
+  statsRow(out,F("Live Streams"),PSTR("{0} of {1} ({2} events dropped)"),NumText(eventClientCount()),NumText(SSE_MAX_CLIENTS),NumText(eventsDropped()));
+  statsRow(out,F("Response Cache"),PSTR("{0} hits, {1} not modified, {2} misses ({3} bytes in RAM)"),
+    NumText(cacheHits()),NumText(cacheNotModified()),NumText(cacheMisses()),NumText(cacheRamBytes()));
+  out.print(F("</table></div>"));
+  
+  out.print(F("<h5 class='mt-4'>Scheduled Tasks</h5><div class='table-responsive'><table class='table table-sm table-striped'>"
+  "<tr><th>Task</th><th>Interval</th><th>Runs</th><th>Avg</th><th>Worst</th><th>Overruns</th></tr>"));
+  for(int i=0;i<taskCount;i++){
+    const Task&t=tasks[i];
+    out.print(F("<tr><td>"));
+    out.print(t.name);
+    out.print(F("</td><td>"));
+    if(t.interval)printDuration(out,t.interval/1000);
+    else out.print(F("once"));
+    out.print(F("</td><td>"));
+    out.print(t.runs);
+    out.print(F("</td><td>"));
+    out.print(t.runs?(uint32_t)(t.totalUs/t.runs):0);
+    out.print(F(" µs</td><td>"));
+    out.print(t.worstUs);
+    out.print(F(" µs</td><td>"));
+    out.print(t.overruns);
+    out.print(F("</td></tr>"));
+  }
+  out.print(F("</table></div>"));
+}
+
+void renderStats(Print&out){
+  Stats s=calculateStats();
+  pageHeader(out,"ESP Stats","stats");
+  out.print(F("<div class='card p-4 mb-3'><h3>📡 Device Statistics</h3>"));
+  out.print(F("<div class='table-responsive'><table class='table table-bordered table-striped mt-3'>"));
+  statsRow(out,F("Chip ID"),PSTR("{0}"),NumText(ESP.getChipId(),true));
+  statsRow(out,F("Flash Chip ID"),PSTR("{0}"),NumText(ESP.getFlashChipId(),true));
+  statsRow(out,F("Flash Size"),PSTR("{0} KB"),NumText(ESP.getFlashChipSize()/1024));
+  statsRow(out,F("Real Flash Size"),PSTR("{0} KB"),NumText(ESP.getFlashChipRealSize()/1024));
+  statsRow(out,F("CPU Frequency"),PSTR("{0} MHz"),NumText(ESP.getCpuFreqMHz()));
+  statsRow(out,F("SDK Version"),PSTR("{0}"),ESP.getSdkVersion());
+  statsRow(out,F("Boot Version"),PSTR("{0}"),NumText(ESP.getBootVersion()));
+  statsRow(out,F("Boot Mode"),PSTR("{0}"),NumText(ESP.getBootMode()));
+  statsRow(out,F("Sketch Size"),PSTR("{0} bytes"),NumText(ESP.getSketchSize()));
+  statsRow(out,F("Free Sketch Space"),PSTR("{0} bytes"),NumText(ESP.getFreeSketchSpace()));
+  statsRow(out,F("Reset Reason"),ESP.getResetReason());
+  statsRow(out,F("Reset Info"),ESP.getResetInfo());
+  
+  FSInfo fs;
+  LittleFS.info(fs);
+  statsRow(out,F("LittleFS Total"),PSTR("{0} bytes"),NumText(fs.totalBytes));
+  statsRow(out,F("Log Segments"),PSTR("{0} ({1} bytes, {2} events)"),NumText(segments.size()),NumText(logBytes()),NumText(logTotal()-logFirst()));
+  statsRow(out,F("Archive"),PSTR("{0} bytes"),NumText(archiveBytes()));
+  out.print(F("</table></div>"));
+  if(staticAssets[1].etag)out.print(F("<div data-fragment='/stats/live'><a href='/stats/live'>Live device status</a></div>"));
+  else renderStatsLive(out);
+  
+  out.print(F("<h5 class='mt-4'>Power Statistics</h5><ul class='list-group'>"));
+  static const char periodItem[] PROGMEM="<li class='list-group-item'>{0}: <span class='float-end'><strong class='text-danger'>OFF: {1}</strong> | "
+  "<strong class='text-success'>ON: {2}</strong></span></li>";
+  printTemplate(out,PSTR("<li class='list-group-item'>Today: <span class='float-end'><strong class='text-danger'>OFF: {0}</strong> | "
+  "<strong class='text-success'>ON: <span data-live='uptime'>{1}</span></strong></span></li>"),DurationText(s.todayOff),DurationText(time(nullptr)-bootTime));
+  printTemplate(out,periodItem,"Last 7 days",DurationText(s.last7Off),DurationText(s.last7On));
+  printTemplate(out,periodItem,"Last 15 days",DurationText(s.last15Off),DurationText(s.last15On));
+  printTemplate(out,periodItem,"Last Month",DurationText(s.monthOff),DurationText(s.monthOn));
+  printTemplate(out,PSTR("</ul><p class='mt-3 text-muted'><small>Raw events are kept for {0} months, then summarised per day.</small></p>"),
+    NumText(std::max(retentionMonths,(uint8_t)RETENTION_MIN_MONTHS)));
+  
+  renderOutageStats(out);
+  out.print(F("</div>"));
+  pageFooter(out);
+}
+
+void renderConfig(Print&out){
+  pageHeader(out,"Configuration","config");
+  out.print(F("<div class='card p-4'><h3>⚙️ Wi-Fi & AP Configuration</h3>"));
+  out.print(F("<form action='/save' method='POST' class='mt-3'>"));
+  static const char form[] PROGMEM="<div class='mb-3'><label class='form-label'>Wi-Fi SSID:</label>"
+  "<input class='form-control' name='ssid' value='{0}' placeholder='Your WiFi Network'></div>"
+  "<div class='mb-3'><label class='form-label'>Wi-Fi Password:</label>"
+  "<input class='form-control' type='password' name='pass' value='{1}' placeholder='WiFi Password'></div>"
+  "<div class='mb-3'><label class='form-label'>Fallback AP SSID:</label>"
+  "<input class='form-control' name='apssid' value='{2}' placeholder='ESP8266_PowerLog'></div>"
+  "<div class='mb-3'><label class='form-label'>Fallback AP Password:</label>"
+  "<input class='form-control' type='password' name='appass' value='{3}' placeholder='Min 8 characters' minlength='8'></div>"
+  "<h5 class='mt-4'>Log Retention</h5><div class='row'>"
+  "<div class='col-sm-6 mb-3'><label class='form-label'>Keep raw events (months):</label>"
+  "<input class='form-control' type='number' name='retmonths' min='2' max='60' value='{4}'></div>"
+  "<div class='col-sm-6 mb-3'><label class='form-label'>Size budget (KB, 0 = none):</label>"
+  "<input class='form-control' type='number' name='retkb' min='0' max='65534' value='{5}'></div></div>";
+  printTemplate(out,form,wifiSSID.c_str(),wifiPASS.c_str(),apSSID.c_str(),apPASS.c_str(),NumText(retentionMonths),NumText(retentionBytes/1024));
+  out.print(F("<button class='btn btn-success w-100 btn-lg'>💾 Save & Restart</button></form></div>"));
+  pageFooter(out);
 }
 
 void handleSave(){
@@ -356,63 +904,430 @@ void handleSave(){
   apPASS.trim();
   
   if(apSSID.length()==0)apSSID="ESP8266_PowerLog";
+  if(server.hasArg("retmonths"))retentionMonths=constrain(server.arg("retmonths").toInt(),RETENTION_MIN_MONTHS,60);
+  if(server.hasArg("retkb"))retentionBytes=constrain(server.arg("retkb").toInt(),0,65534)*1024;
   
-  Serial.println("Saving WiFi config:");
+  Serial.println(F("Saving WiFi config:"));
   Serial.println("  SSID: "+wifiSSID+" (length: "+String(wifiSSID.length())+")");
   String passInfo=(wifiPASS.length()>0)?"[SET]":"[EMPTY]";
   Serial.println("  Password: "+passInfo+" (length: "+String(wifiPASS.length())+")");
   
   saveConfig();
-  String html=pageHeader("Configuration Saved","");
-  html+="<div class='card p-4 text-center'>"
+  ChunkedWriter out;
+  pageHeader(out,"Configuration Saved","");
+  out.print(F("<div class='card p-4 text-center'>"
   "<div class='alert alert-success'><h4>✓ Configuration Saved Successfully!</h4></div>"
   "<p class='lead'>Device is restarting...</p>"
   "<div class='spinner-border text-primary mt-3' role='status'><span class='visually-hidden'>Loading...</span></div>"
-  "</div>"+pageFooter();
-  server.send(200,"text/html",html);
-  delay(2000);
-  ESP.restart();
+  "</div>"));
+  pageFooter(out);
+  out.end();
+  // Restart from loop() context once the response has gone out
+  if(scheduleOnce("restart",[](){ESP.restart();},2000)<0)ESP.restart();
 }
 
+// Serves the stored response for this request (or a 304), otherwise
+// renders it and stores what was sent. See cache.h.
+void cachedResponse(const char*contentType,void(*render)(Print&)){
+  uint32_t request=requestKey(server);
+  uint32_t key=cacheKey(server,request);
+  if(serveCached(server,key,contentType)){
+    noteResponse();
+    return;
+  }
+  CacheCapture capture(key,request);
+  {
+    ChunkedWriter out(contentType);
+    out.tee=&capture;
+    render(out);
+  }
+  capture.commit();
+}
+
+// Pages are only cached when app.js is served to refresh their live
+// fields; without it they are rendered for every request as before.
 void handleRoot(){
-  server.send(200,"text/html",getHTML());
+  if(staticAssets[1].etag){
+    cachedResponse("text/html",renderHistory);
+    return;
+  }
+  ChunkedWriter out;
+  renderHistory(out);
 }
 
 void handleStats(){
-  server.send(200,"text/html",statsPage());
+  if(staticAssets[1].etag){
+    cachedResponse("text/html",renderStats);
+    return;
+  }
+  ChunkedWriter out;
+  renderStats(out);
+}
+
+void handleStatsLive(){
+  ChunkedWriter out;
+  renderStatsLive(out);
+}
+
+void handleApiLog(){
+  if(server.arg("format")=="csv"){
+    server.sendHeader("Content-Disposition","attachment; filename=power_log.csv");
+    cachedResponse("text/csv",renderLogCsv);
+    return;
+  }
+  cachedResponse("application/json",renderLogJson);
+}
+
+// All segments joined into the single-file layout
+void handleApiLogRaw(){
+  if(segments.empty()){
+    noteResponse();
+    server.send(404,"text/plain","No log");
+    return;
+  }
+  server.sendHeader("Content-Disposition","attachment; filename=power_log.bin");
+  ChunkedWriter out("application/octet-stream");
+  writeLogRaw(out);
+}
+
+// from/to as in /api/log; the archive is read in one pass, not paged
+void handleApiArchive(){
+  cachedResponse("application/json",[](Print&out){
+    writeArchiveJson(out,server.hasArg("from")?(time_t)server.arg("from").toInt():0,
+      server.hasArg("to")?(time_t)server.arg("to").toInt():0);
+  });
+}
+
+void handleApiSupply(){
+  if(!SUPPLY_SENSE){
+    noteResponse();
+    server.send(404,"text/plain","Supply sampling not built in (SUPPLY_SENSE)");
+    return;
+  }
+  ChunkedWriter out("application/json");
+  writeSupplyJson(out);
+}
+
+void handleApiDaily(){
+  cachedResponse("application/json",writeDailyJson);
+}
+
+// Not cached: it carries heap, uptime and WiFi alongside the log figures
+void handleApiStats(){
+  ChunkedWriter out("application/json");
+  renderStatsJson(out);
+}
+
+// The volatile fields of the cached pages, as in the /events status event
+void handleApiStatus(){
+  noteResponse();
+  char data[160];
+  size_t n=statusJson(data,sizeof(data));
+  server.send(200,"application/json",data);
+  countResponseBytes(n);
+}
+
+// streamFile() adds "Content-Encoding: gzip" itself for *.gz files.
+void handleStaticAsset(const StaticAsset&a){
+  noteResponse();
+  String etag=assetETag(a);
+  server.sendHeader("ETag",etag);
+  server.sendHeader("Cache-Control","public, max-age=31536000, immutable");
+  if(server.header("If-None-Match")==etag){
+    server.send(304);
+    return;
+  }
+  File f=LittleFS.open(String(a.path)+".gz","r");
+  if(!f){
+    server.send(404,"text/plain","Not found");
+    return;
+  }
+  countResponseBytes(server.streamFile(f,a.contentType));
+  f.close();
+}
+
+void handleMetrics(){
+  ChunkedWriter out("text/plain; version=0.0.4");
+  renderMetrics(out);
 }
 
 void handleConfig(){
-  server.send(200,"text/html",configPage());
+  ChunkedWriter out;
+  renderConfig(out);
 }
 
 void handleClear(){
-  SPIFFS.remove(logFile);
-  SPIFFS.remove(lastOnFile);
-  String html=pageHeader("Logs Cleared","");
-  html+="<div class='card p-4 text-center'>"
+  clearLog();
+  clearResponseCache();
+  ChunkedWriter out;
+  pageHeader(out,"Logs Cleared","");
+  out.print(F("<div class='card p-4 text-center'>"
   "<div class='alert alert-warning'><h4>🗑️ All Logs Cleared!</h4></div>"
   "<p>Redirecting to home page...</p>"
   "<div class='spinner-border text-warning mt-3' role='status'><span class='visually-hidden'>Loading...</span></div>"
-  "</div><meta http-equiv='refresh' content='2;url=/'>"+pageFooter();
-  server.send(200,"text/html",html);
+  "</div><meta http-equiv='refresh' content='2;url=/'>"));
+  pageFooter(out);
+}
+
+// Runs a couple of seconds after a configTime() retry instead of blocking loop().
+void ntpCheckTask(){
+  time_t now=time(nullptr);
+  if(now>=100000){
+    Serial.println("✓ NTP sync successful: "+getTimeString(now));
+    ntpSynced=true;
+  }
+}
+
+// Auto-reconnect WiFi if configured and disconnected (for repeater mode)
+void wifiCheckTask(){
+  static bool wasConnected=false;
+  if(wifiSSID.length()==0)return;
+  bool isConnected=(WiFi.status()==WL_CONNECTED);
+  if(isConnected!=wasConnected)sendWifiEvent(isConnected);
+  if(!isConnected&&WiFi.getMode()!=WIFI_AP){
+    Serial.println(F("WiFi disconnected. Attempting reconnect..."));
+    wifiReconnectAttempts++;
+    WiFi.mode(WIFI_AP_STA);
+    WiFi.begin(wifiSSID.c_str(),wifiPASS.c_str());
+  }else if(isConnected&&!wasConnected){
+    wifiReconnects++;
+    Serial.println("✓ WiFi reconnected! IP: "+WiFi.localIP().toString());
+    Serial.println(F("✓ Repeater Mode Active"));
+  }
+  wasConnected=isConnected;
+}
+
+// Update the last-on timestamp. Not before the boot entries are logged:
+// the previous stamp is still needed to time the outage.
+void heartbeatTask(){
+  time_t now=time(nullptr);
+  if(now<100000||bootState!=BOOT_DONE)return;
+  writeHeartbeat(now);
+}
+
+void rtcAliveTask(){
+  time_t now=time(nullptr);
+  if(now>=100000&&bootState==BOOT_DONE)writeRtcAlive(now);
+}
+
+// Retry NTP sync if time is invalid and WiFi is connected
+void ntpRetryTask(){
+  if(ntpSynced||!hal.net->connected())return;
+  if(time(nullptr)<100000){
+    Serial.println(F("Retrying NTP sync..."));
+    configTime(6*3600,0,"pool.ntp.org","time.nist.gov");
+    scheduleOnce("ntp-check",ntpCheckTask,2000);
+  }else{
+    ntpSynced=true;
+  }
+}
+
+// Serial console commands, one per line. "bench [sizes]" runs the
+// benchmark suite and prints its JSON lines; it blocks the web server
+// while it runs.
+char serialLine[64];
+size_t serialLen=0;
+
+void serialCommandTask(){
+  while(Serial.available()){
+    char c=Serial.read();
+    if(c!='\n'&&c!='\r'){
+      if(serialLen<sizeof(serialLine)-1)serialLine[serialLen++]=c;
+      continue;
+    }
+    if(serialLen==0)continue;
+    serialLine[serialLen]=0;
+    serialLen=0;
+    if(strncmp(serialLine,"bench",5)==0){
+      size_t sizes[BENCH_MAX_SIZES];
+      size_t count=parseBenchSizes(serialLine+5,sizes,BENCH_MAX_SIZES);
+      runBenchmarks(Serial,"esp8266",sizes,count);
+    }else{
+      Serial.println("Unknown command: "+String(serialLine));
+    }
+  }
+}
+
+// Logs the outage that ended at this boot and the power-on, once the
+// clock is valid. bootTime is backdated by the time since setup() began.
+void logBootEvents(time_t now){
+  bootTiming.timeValid=millis();
+  ntpSynced=true;
+  bootTime=now-(time_t)((bootTiming.timeValid-bootTiming.setup)/1000);
+  
+  if(bootLastOn>0&&bootTime>bootLastOn){
+    time_t offDuration=bootTime-bootLastOn;
+    if(bootPowerLoss){
+      logEvent(EV_OFF|(bootResetReason<<4),bootLastOn,offDuration);
+      Serial.println("Power OFF duration: "+formatDuration(offDuration));
+    }else{
+      logEvent(EV_RESTART|(bootResetReason<<4),bootLastOn,offDuration);
+      Serial.println(String("Restart (")+resetCauseName(bootResetReason)+"), down for "+formatDuration(offDuration));
+    }
+  }
+  
+  writeHeartbeat(now);
+  writeRtcAlive(now);
+  LittleFS.remove(legacyLastOnFile);
+  logEvent(EV_ON,bootTime,0);
+  bootTiming.logged=millis();
+  Serial.println("Power ON logged at: "+getTimeString(bootTime)+" (time valid "+String(bootTiming.timeValid)+" ms after reset)");
+}
+
+#if SUPPLY_SENSE
+Ticker supplyTicker;
+
+void supplyTask(){
+  supplyPoll(bootState==BOOT_DONE);
+}
+#endif
+
+void bootTask(){
+  uint32_t now=millis();
+  if(bootState==BOOT_WIFI){
+    if(WiFi.status()==WL_CONNECTED){
+      bootTiming.wifi=now;
+      Serial.println("✓ Connected to WiFi after "+String(now-bootTiming.serverReady)+" ms");
+      Serial.println("  Station IP: "+WiFi.localIP().toString());
+      Serial.println("  Signal: "+String(WiFi.RSSI())+" dBm");
+      Serial.println(F("✓ Repeater Mode Active (AP + STA)"));
+      digitalWrite(LED_PIN,HIGH);
+      sendWifiEvent(true);
+      bootState=BOOT_TIME;
+    }else if(now-bootTiming.serverReady>=WIFI_CONNECT_TIMEOUT){
+      Serial.println(F("✗ Failed to connect to WiFi"));
+      Serial.println("  Status: "+String(WiFi.status()));
+      Serial.println(F("⚠ AP-only mode (repeater disabled until WiFi connects)"));
+      // Keep WIFI_AP_STA mode so the wifi task keeps retrying
+      digitalWrite(LED_PIN,HIGH);
+      bootState=BOOT_TIME;
+    }else{
+      digitalWrite(LED_PIN,!digitalRead(LED_PIN));
+      return;
+    }
+  }
+  if(bootState!=BOOT_TIME)return;
+  time_t t=time(nullptr);
+  if(t<100000){
+    static bool slowed=false;
+    if(!slowed&&now-bootTiming.serverReady>=NTP_SYNC_TIMEOUT){
+      Serial.println(F("⚠ No valid time yet, power logging waits for NTP"));
+      scheduleTask("boot",bootTask,5000,5000);
+      slowed=true;
+    }
+    return;
+  }
+  logBootEvents(t);
+  bootState=BOOT_DONE;
+  cancelTask("boot");
 }
 
+// SPIFFS is deprecated in the core but still needed to read old logs
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+// Reads the newest max bytes of path on SPIFFS, starting at a line
+// boundary when the file is longer.
+String readSpiffsTail(const String&path,size_t max){
+  String text;
+  File f=SPIFFS.open(path,"r");
+  if(!f)return text;
+  if(f.size()>max){
+    f.seek(f.size()-max,SeekSet);
+    f.readStringUntil('\n');
+    Serial.println("Keeping the newest "+String(max)+" of "+String(f.size())+" bytes of "+path);
+  }
+  text=f.readString();
+  f.close();
+  return text;
+}
+
+// Mounts LittleFS. Firmware before the LittleFS switch kept its log on
+// SPIFFS, which LittleFS.begin() would format away, so an unmountable
+// partition is first tried as SPIFFS: the old text log and last-on stamp
+// are held in RAM while it is reformatted, then written back for
+// migrateTextLog() to convert.
+void mountFilesystem(){
+  LittleFS.setConfig(LittleFSConfig(false));
+  if(LittleFS.begin())return;
+  String log,lastOn;
+  SPIFFS.setConfig(SPIFFSConfig(false));
+  if(SPIFFS.begin()){
+    log=readSpiffsTail(legacyLogFile,std::min((size_t)LEGACY_LOG_MAX,(size_t)ESP.getMaxFreeBlockSize()/2));
+    lastOn=readSpiffsTail(legacyLastOnFile,32);
+    SPIFFS.end();
+    Serial.println("Found a SPIFFS log of "+String(log.length())+" bytes, moving it to LittleFS");
+  }
+  if(!LittleFS.format()||!LittleFS.begin()){
+    Serial.println(F("⚠ LittleFS format failed, nothing will be stored"));
+    return;
+  }
+  if(log.length()){
+    File f=LittleFS.open(legacyLogFile,"w");
+    if(f){
+      f.print(log);
+      f.close();
+    }
+  }
+  if(lastOn.length()){
+    File f=LittleFS.open(legacyLastOnFile,"w");
+    if(f){
+      f.print(lastOn);
+      f.close();
+    }
+  }
+}
+
+#pragma GCC diagnostic pop
+
 void setup(){
+  bootTiming.setup=millis();
+  // Classify this boot before anything touches RTC memory: the stamp only
+  // survives if power never dropped.
+  rst_info*rst=ESP.getResetInfoPtr();
+  bootResetReason=rst?rst->reason:REASON_DEFAULT_RST;
+  time_t rtcAlive=0;
+  bool rtcValid=readRtcAlive(rtcAlive);
+  bootPowerLoss=!rtcValid||bootResetReason==REASON_DEFAULT_RST;
+  
   Serial.begin(115200);
   pinMode(LED_PIN,OUTPUT);
   digitalWrite(LED_PIN,LOW);
   
-  SPIFFS.begin();
+  mountFilesystem();
+  EEPROM.begin(EEPROM_SIZE);
+  loadStaticAssets();
+  clearResponseCache(); // files left by the last boot
+  migrateTextLog();
   loadConfig();
+  loadRetention();
+  
+  // Sets the timezone now, so segments split on local month boundaries;
+  // SNTP syncs in the background once the station is connected.
+  configTime(6*3600,0,"pool.ntp.org","time.nist.gov");
+  resetCalendarCache();
+  loadSegments();
+  migrateFlatLog();
+  applyRetention();
+  loadAggregates();
   
-  Serial.println("\n=== WiFi Configuration ===");
+  bootLastOn=readHeartbeat();
+  if(bootLastOn==0){
+    // Last-on stamp written by older firmware
+    File f=LittleFS.open(legacyLastOnFile,"r");
+    if(f){
+      bootLastOn=f.readString().toInt();
+      f.close();
+    }
+  }
+  if(rtcValid&&rtcAlive>bootLastOn)bootLastOn=rtcAlive;
+  
+  Serial.println(F("\n=== WiFi Configuration ==="));
   Serial.println("SSID from EEPROM: "+wifiSSID+" (length: "+String(wifiSSID.length())+")");
   Serial.println("Password length: "+String(wifiPASS.length()));
   
-  bool wifiConnected=false;
   if(wifiSSID.length()>0){
-    Serial.println("\nStarting Repeater Mode (AP + STA)");
+    Serial.println(F("\nStarting Repeater Mode (AP + STA)"));
     WiFi.mode(WIFI_AP_STA); // Set mode FIRST
     
     // Start AP for repeater functionality
@@ -421,157 +1336,64 @@ void setup(){
     delay(100); // Give AP time to start
     Serial.println("AP IP: "+WiFi.softAPIP().toString());
     
-    // Connect to WiFi as station
+    // The station connects in the background, see bootTask()
     Serial.println("\nConnecting to WiFi: '"+wifiSSID+"'");
     WiFi.begin(wifiSSID.c_str(),wifiPASS.c_str());
-    unsigned long start=millis();
-    int dots=0;
-    while(WiFi.status()!=WL_CONNECTED&&millis()-start<20000){
-      digitalWrite(LED_PIN,!digitalRead(LED_PIN));
-      delay(250);
-      if(dots++%4==0)Serial.print(".");
-    }
-    Serial.println();
-    if(WiFi.status()==WL_CONNECTED){
-      Serial.println("✓ Connected to WiFi!");
-      Serial.println("  Station IP: "+WiFi.localIP().toString());
-      Serial.println("  AP IP: "+WiFi.softAPIP().toString());
-      Serial.println("  Signal: "+String(WiFi.RSSI())+" dBm");
-      Serial.println("✓ Repeater Mode Active (AP + STA)");
-      wifiConnected=true;
-      digitalWrite(LED_PIN,HIGH);
-    }else{
-      Serial.println("✗ Failed to connect to WiFi");
-      Serial.println("  Status: "+String(WiFi.status()));
-      Serial.println("  AP remains active at: "+WiFi.softAPIP().toString());
-      Serial.println("⚠ AP-only mode (repeater disabled until WiFi connects)");
-      // Keep WIFI_AP_STA mode - don't switch to WIFI_AP
-      // This allows auto-reconnection attempts
-      digitalWrite(LED_PIN,HIGH);
-    }
+    bootState=BOOT_WIFI;
   }else{
-    Serial.println("No WiFi credentials configured");
+    Serial.println(F("No WiFi credentials configured"));
     Serial.println("AP Mode Only - Connect to "+apSSID);
     WiFi.mode(WIFI_AP);
     digitalWrite(LED_PIN,HIGH);
+    Serial.println(F("⚠ No internet: power logging waits until the clock is valid"));
+    bootState=BOOT_TIME;
   }
   
-  // Sync time AFTER WiFi connects (needs internet)
-  Serial.println("\n=== Time Synchronization ===");
-  configTime(6*3600,0,"pool.ntp.org","time.nist.gov");
-  if(wifiConnected){
-    Serial.print("Syncing time from NTP");
-    int attempts=0;
-    while(time(nullptr)<100000&&attempts++<60){
-      Serial.print(".");
-      delay(500);
-    }
-    if(time(nullptr)>=100000){
-      Serial.println(" ✓ Success!");
-      Serial.println("Current time: "+getTimeString(time(nullptr)));
-    }else{
-      Serial.println(" ✗ Failed (using system time)");
-    }
-  }else{
-    Serial.println("⚠ Skipping NTP sync (no internet connection)");
-    Serial.println("Time will show as 1970 until WiFi connects");
+  addRoute(server,"/",HTTP_ANY,handleRoot);
+  addRoute(server,"/stats",HTTP_ANY,handleStats);
+  addRoute(server,"/stats/live",HTTP_ANY,handleStatsLive);
+  addRoute(server,"/config",HTTP_ANY,handleConfig);
+  addRoute(server,"/save",HTTP_POST,handleSave);
+  addRoute(server,"/clear",HTTP_ANY,handleClear);
+  addRoute(server,"/api/log",HTTP_ANY,handleApiLog);
+  addRoute(server,"/api/log.raw",HTTP_ANY,handleApiLogRaw);
+  addRoute(server,"/api/stats",HTTP_ANY,handleApiStats);
+  addRoute(server,"/api/status",HTTP_GET,handleApiStatus);
+  addRoute(server,"/api/daily",HTTP_ANY,handleApiDaily);
+  addRoute(server,"/api/archive",HTTP_ANY,handleApiArchive);
+  addRoute(server,"/api/supply",HTTP_ANY,handleApiSupply);
+  addRoute(server,"/events",HTTP_GET,[](){handleEvents(server);});
+  addRoute(server,"/metrics",HTTP_GET,handleMetrics);
+  for(const StaticAsset&a:staticAssets){
+    if(a.etag)addRoute(server,a.path,HTTP_GET,[&a](){handleStaticAsset(a);});
   }
+  scheduleTask("boot",bootTask,250,0);
+  scheduleTask("wifi",wifiCheckTask,30000,30000);
+  scheduleTask("heartbeat",heartbeatTask,HEARTBEAT_INTERVAL,HEARTBEAT_INTERVAL);
+  scheduleTask("ntp",ntpRetryTask,60000,60000);
+  scheduleTask("rtc-alive",rtcAliveTask,RTC_ALIVE_INTERVAL,RTC_ALIVE_INTERVAL);
+  scheduleTask("serial",serialCommandTask,100,100);
+  scheduleTask("events",sendStatusEvent,SSE_STATUS_INTERVAL,SSE_STATUS_INTERVAL);
+#if SUPPLY_SENSE
+  // The timer only reads the ADC (tens of microseconds); the ring is
+  // drained from the scheduler, so handlers never wait on sampling
+  supplyTicker.attach_ms(1000/SUPPLY_RATE_HZ,supplySample);
+  scheduleTask("supply",supplyTask,SUPPLY_POLL_INTERVAL,SUPPLY_POLL_INTERVAL);
+#endif
+  logEventHook=sendLogEvent;
+  addBenchOp("render_history",renderHistory);
+  addBenchOp("render_stats",renderStats);
   
-  bootTime=time(nullptr);
-  if(bootTime<100000){
-    Serial.println("⚠ Warning: Invalid time detected ("+String(bootTime)+")");
-    bootTime=0; // Mark as invalid
-  }
-  
-  checkMonthlyReset();
-  
-  time_t lastOn=0;
-  time_t offDuration=0;
-  File f=SPIFFS.open(lastOnFile,"r");
-  if(f){
-    lastOn=f.readString().toInt();
-    f.close();
-  }
-  
-  if(lastOn>0&&bootTime>lastOn&&bootTime>=100000){
-    offDuration=bootTime-lastOn;
-    logEvent("[OFF]",lastOn,offDuration);
-    Serial.println("Power OFF duration: "+formatDuration(offDuration));
-  }
-  
-  if(bootTime>=100000){
-    File lf=SPIFFS.open(lastOnFile,"w");
-    if(lf){
-      lf.print(bootTime);
-      lf.close();
-    }
-    logEvent("[ON]",bootTime,0);
-    Serial.println("Power ON logged at: "+getTimeString(bootTime));
-  }else{
-    Serial.println("⚠ Skipping power logging (invalid time)");
-  }
-  
-  server.on("/",handleRoot);
-  server.on("/stats",handleStats);
-  server.on("/config",handleConfig);
-  server.on("/save",HTTP_POST,handleSave);
-  server.on("/clear",handleClear);
+  const char*headerKeys[]={"If-None-Match"};
+  server.collectHeaders(headerKeys,1);
   server.begin();
-  Serial.println("Web server started!");
+  bootTiming.serverReady=millis();
+  Serial.println("Web server started "+String(bootTiming.serverReady)+" ms after reset");
 }
 
 void loop(){
+  uint32_t start=micros();
   server.handleClient();
-  
-  // Auto-reconnect WiFi if configured and disconnected (for repeater mode)
-  static unsigned long lastWiFiCheck=0;
-  static bool wasConnected=false;
-  if(wifiSSID.length()>0&&millis()-lastWiFiCheck>30000){
-    bool isConnected=(WiFi.status()==WL_CONNECTED);
-    if(!isConnected&&WiFi.getMode()!=WIFI_AP){
-      Serial.println("WiFi disconnected. Attempting reconnect...");
-      WiFi.mode(WIFI_AP_STA);
-      WiFi.begin(wifiSSID.c_str(),wifiPASS.c_str());
-    }else if(isConnected&&!wasConnected){
-      Serial.println("✓ WiFi reconnected! IP: "+WiFi.localIP().toString());
-      Serial.println("✓ Repeater Mode Active");
-    }
-    wasConnected=isConnected;
-    lastWiFiCheck=millis();
-  }
-  
-  // Update timestamp every hour
-  static unsigned long lastCheck=0;
-  if(millis()-lastCheck>3600000){
-    time_t now=time(nullptr);
-    if(now>=100000){
-      File lf=SPIFFS.open(lastOnFile,"w");
-      if(lf){
-        lf.print(now);
-        lf.close();
-      }
-    }
-    lastCheck=millis();
-  }
-  
-  // Retry NTP sync if time is invalid and WiFi is connected
-  static unsigned long lastNTPCheck=0;
-  static bool ntpSynced=false;
-  if(!ntpSynced&&WiFi.status()==WL_CONNECTED&&millis()-lastNTPCheck>60000){
-    time_t now=time(nullptr);
-    if(now<100000){
-      Serial.println("Retrying NTP sync...");
-      configTime(6*3600,0,"pool.ntp.org","time.nist.gov");
-      delay(2000);
-      now=time(nullptr);
-      if(now>=100000){
-        Serial.println("✓ NTP sync successful: "+getTimeString(now));
-        ntpSynced=true;
-        bootTime=now;
-      }
-    }else{
-      ntpSynced=true;
-    }
-    lastNTPCheck=millis();
-  }
+  runScheduler();
+  loopLatency.observe(micros()-start);
 }
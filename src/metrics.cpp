@@ -0,0 +1,148 @@
+#include "metrics.h"
+
+static const uint32_t routeBounds[]={1000,5000,10000,25000,50000,100000,250000,500000,1000000,2500000,5000000};
+static const uint32_t loopBounds[]={50,100,500,1000,5000,10000,50000,100000,500000};
+
+Histogram loopLatency(loopBounds,sizeof(loopBounds)/sizeof(loopBounds[0]));
+
+static RouteMetrics*routes[METRICS_MAX_ROUTES];
+static size_t routeCount=0;
+static RouteMetrics*currentRoute=nullptr;
+
+Histogram::Histogram(const uint32_t*bounds,uint8_t buckets):bounds(bounds),buckets(buckets),count(0),sumUs(0){
+  memset(counts,0,sizeof(counts));
+}
+
+void Histogram::observe(uint32_t us){
+  uint8_t i=0;
+  while(i<buckets&&us>bounds[i])i++;
+  counts[i]++;
+  count++;
+  sumUs+=us;
+}
+
+void addRoute(ESP8266WebServer&server,const char*path,HTTPMethod method,std::function<void()>handler){
+  RouteMetrics*m=nullptr;
+  for(size_t i=0;i<routeCount;i++){
+    if(strcmp(routes[i]->path,path)==0)m=routes[i];
+  }
+  if(!m&&routeCount<METRICS_MAX_ROUTES){
+    m=new RouteMetrics{path,0,0,Histogram(routeBounds,sizeof(routeBounds)/sizeof(routeBounds[0]))};
+    routes[routeCount++]=m;
+  }
+  if(!m){
+    server.on(path,method,handler);
+    return;
+  }
+  server.on(path,method,[m,handler](){
+    uint32_t start=micros();
+    currentRoute=m;
+    handler();
+    currentRoute=nullptr;
+    m->requests++;
+    m->latency.observe(micros()-start);
+  });
+}
+
+void countResponseBytes(size_t n){
+  if(currentRoute)currentRoute->bytes+=n;
+}
+
+void metricHeader(Print&out,const __FlashStringHelper*name,const char*type,const __FlashStringHelper*help){
+  out.print("# HELP ");
+  out.print(name);
+  out.print(" ");
+  out.print(help);
+  out.print('\n');
+  out.print("# TYPE ");
+  out.print(name);
+  out.print(" ");
+  out.print(type);
+  out.print('\n');
+}
+
+static void metricName(Print&out,const __FlashStringHelper*name,const char*suffix,const char*labels,const char*extra){
+  out.print(name);
+  out.print(suffix);
+  if(!*labels&&!*extra)return;
+  out.print("{");
+  out.print(labels);
+  if(*labels&&*extra)out.print(",");
+  out.print(extra);
+  out.print("}");
+}
+
+static void printUint64(Print&out,uint64_t v){
+  char buf[21];
+  char*p=buf+sizeof(buf)-1;
+  *p=0;
+  do{
+    *--p='0'+v%10;
+    v/=10;
+  }while(v);
+  out.print(p);
+}
+
+// Microseconds as seconds with six decimals, without going through float
+static void printSeconds(Print&out,uint64_t us){
+  printUint64(out,us/1000000);
+  char frac[8];
+  snprintf(frac,sizeof(frac),".%06lu",(unsigned long)(us%1000000));
+  out.print(frac);
+}
+
+void metricValue(Print&out,const __FlashStringHelper*name,const char*labels,uint64_t value){
+  metricName(out,name,"",labels,"");
+  out.print(" ");
+  printUint64(out,value);
+  out.print('\n');
+}
+
+void metricSeconds(Print&out,const __FlashStringHelper*name,const char*labels,uint64_t us){
+  metricName(out,name,"",labels,"");
+  out.print(" ");
+  printSeconds(out,us);
+  out.print('\n');
+}
+
+// Bucket bounds and the sum in seconds, as Prometheus expects
+void metricHistogram(Print&out,const __FlashStringHelper*name,const char*labels,const Histogram&h){
+  char le[24];
+  uint32_t cumulative=0;
+  for(uint8_t i=0;i<=h.buckets;i++){
+    cumulative+=h.counts[i];
+    if(i<h.buckets)snprintf(le,sizeof(le),"le=\"%lu.%06lu\"",(unsigned long)(h.bounds[i]/1000000),(unsigned long)(h.bounds[i]%1000000));
+    else strcpy(le,"le=\"+Inf\"");
+    metricName(out,name,"_bucket",labels,le);
+    out.print(" ");
+    out.print(cumulative);
+    out.print('\n');
+  }
+  metricName(out,name,"_sum",labels,"");
+  out.print(" ");
+  printSeconds(out,h.sumUs);
+  out.print('\n');
+  metricName(out,name,"_count",labels,"");
+  out.print(" ");
+  out.print(h.count);
+  out.print('\n');
+}
+
+void writeRouteMetrics(Print&out){
+  char labels[48];
+  metricHeader(out,F("esp_http_requests_total"),"counter",F("HTTP requests handled, by route."));
+  for(size_t i=0;i<routeCount;i++){
+    snprintf(labels,sizeof(labels),"route=\"%s\"",routes[i]->path);
+    metricValue(out,F("esp_http_requests_total"),labels,routes[i]->requests);
+  }
+  metricHeader(out,F("esp_http_response_bytes_total"),"counter",F("Response body bytes sent, by route."));
+  for(size_t i=0;i<routeCount;i++){
+    snprintf(labels,sizeof(labels),"route=\"%s\"",routes[i]->path);
+    metricValue(out,F("esp_http_response_bytes_total"),labels,routes[i]->bytes);
+  }
+  metricHeader(out,F("esp_http_request_duration_seconds"),"histogram",F("Time spent in the route handler."));
+  for(size_t i=0;i<routeCount;i++){
+    snprintf(labels,sizeof(labels),"route=\"%s\"",routes[i]->path);
+    metricHistogram(out,F("esp_http_request_duration_seconds"),labels,routes[i]->latency);
+  }
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <Arduino.h>
+#include <ESP8266WebServer.h>
+#include <functional>
+
+// Request and loop instrumentation for /metrics (Prometheus text
+// format). Every route registered through addRoute() counts requests,
+// response bytes and a latency histogram; recording is a few integer
+// operations, cheap enough for every request and every loop() pass.
+
+#define METRICS_MAX_ROUTES 20
+#define METRICS_MAX_BUCKETS 12
+
+// Counts per fixed upper bound in microseconds; the last bucket is +Inf
+struct Histogram{
+  const uint32_t*bounds;
+  uint8_t buckets;
+  uint32_t counts[METRICS_MAX_BUCKETS];
+  uint32_t count;
+  uint64_t sumUs;
+  
+  Histogram(const uint32_t*bounds,uint8_t buckets);
+  void observe(uint32_t us);
+};
+
+struct RouteMetrics{
+  const char*path;
+  uint32_t requests;
+  uint64_t bytes;
+  Histogram latency;
+};
+
+extern Histogram loopLatency;
+
+// Registers handler on server and wraps it with the route's metrics
+void addRoute(ESP8266WebServer&server,const char*path,HTTPMethod method,std::function<void()>handler);
+// Response bytes of the request being handled (0 outside a handler)
+void countResponseBytes(size_t n);
+
+// Prometheus text helpers. labels is e.g. "route=\"/\"" or "".
+// Names and help texts are flash strings (F()). Lines end in a bare
+// "\n": println() would add "\r\n", which scrapers reject.
+void metricHeader(Print&out,const __FlashStringHelper*name,const char*type,const __FlashStringHelper*help);
+void metricValue(Print&out,const __FlashStringHelper*name,const char*labels,uint64_t value);
+// A duration measured in microseconds, written in seconds (base unit)
+void metricSeconds(Print&out,const __FlashStringHelper*name,const char*labels,uint64_t us);
+void metricHistogram(Print&out,const __FlashStringHelper*name,const char*labels,const Histogram&h);
+void writeRouteMetrics(Print&out);
@@ -0,0 +1,57 @@
+#include <malloc.h>
+#include <chrono>
+#include <new>
+#include <sys/stat.h>
+#include "hal_native.h"
+
+FakeClock fakeClock;
+RamStore ramStore;
+FakeNetwork fakeNetwork;
+ReplayAdc replayAdc;
+static StdoutPrint stdoutPrint;
+static NewHeapProbe heapProbe;
+static fs::FS*nativeFs=nullptr;
+
+Hal hal={nullptr,&fakeClock,&ramStore,&fakeNetwork,&stdoutPrint,&heapProbe,&replayAdc};
+
+uint32_t FakeClock::micros(){
+  static auto t0=std::chrono::steady_clock::now();
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now()-t0).count();
+}
+
+// GCC flags the malloc/free pairing once these are inlined into callers
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+static size_t heapLive=0,heapStart=0,heapPeak=0,heapAllocs=0;
+
+void*operator new(size_t n){
+  void*p=malloc(n?n:1);
+  if(!p)throw std::bad_alloc();
+  heapLive+=malloc_usable_size(p);
+  heapPeak=std::max(heapPeak,heapLive);
+  heapAllocs++;
+  return p;
+}
+
+void operator delete(void*p)noexcept{
+  if(!p)return;
+  heapLive-=malloc_usable_size(p);
+  free(p);
+}
+
+void operator delete(void*p,size_t)noexcept{operator delete(p);}
+
+void NewHeapProbe::begin(){
+  heapStart=heapPeak=heapLive;
+  heapAllocs=0;
+}
+
+size_t NewHeapProbe::peakBytes(){return heapPeak-heapStart;}
+size_t NewHeapProbe::allocations(){return heapAllocs;}
+
+void mountNativeFs(const std::string&dir){
+  mkdir(dir.c_str(),0755);
+  delete nativeFs;
+  nativeFs=new fs::FS(dir);
+  hal.fs=nativeFs;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <map>
+#include <string>
+#include <vector>
+#include "../hal.h"
+
+// Host bindings for hal: the filesystem is a directory on disk, the
+// clock is driven by the caller and the key/value store lives in RAM.
+
+class FakeClock:public Clock{
+public:
+  time_t now()override{return wall;}
+  uint32_t millis()override{return ms;}
+  uint32_t micros()override;  // real time, for benchmarks
+  void set(time_t t){ms+=(uint32_t)(t-wall)*1000;wall=t;}
+  time_t wall=0;
+  uint32_t ms=0;
+};
+
+class RamStore:public KeyValueStore{
+public:
+  uint8_t read(int addr)override{auto it=bytes.find(addr);return it==bytes.end()?0xFF:it->second;}
+  void write(int addr,uint8_t value)override{bytes[addr]=value;}
+  bool commit()override{commits++;return true;}
+  std::map<int,uint8_t>bytes;
+  unsigned commits=0;
+};
+
+class FakeNetwork:public Network{
+public:
+  bool connected()override{return up;}
+  int32_t rssi()override{return up?-60:0;}
+  bool up=true;
+};
+
+// Counts operator new/delete, which is where the native String and
+// std::vector allocate.
+class NewHeapProbe:public HeapProbe{
+public:
+  void begin()override;
+  size_t peakBytes()override;
+  size_t allocations()override;
+  size_t freeBytes()override{return 0;}
+};
+
+// Plays back a recorded waveform, one sample per read(), then repeats
+// the last sample.
+class ReplayAdc:public AnalogSource{
+public:
+  uint16_t read()override{return pos<samples.size()?samples[pos++]:(samples.empty()?0:samples.back());}
+  std::vector<uint16_t>samples;
+  size_t pos=0;
+};
+
+class StdoutPrint:public Print{
+public:
+  size_t write(uint8_t c)override{return fputc(c,stdout)==EOF?0:1;}
+  size_t write(const uint8_t*buf,size_t len)override{return fwrite(buf,1,len,stdout);}
+};
+
+extern FakeClock fakeClock;
+extern RamStore ramStore;
+extern FakeNetwork fakeNetwork;
+extern ReplayAdc replayAdc;
+
+// Points hal.fs at a fresh filesystem rooted in dir (created if missing)
+void mountNativeFs(const std::string&dir);
@@ -0,0 +1,114 @@
+#pragma once
+// Minimal Arduino API for the native build: just the String and Print
+// surface used by the logging and statistics core.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+
+#define HEX 16
+#define DEC 10
+
+inline void yield(){}
+
+class String{
+public:
+  String(){}
+  String(const char*s){if(s)str=s;}
+  String(const std::string&s):str(s){}
+  String(char c):str(1,c){}
+  String(int v,unsigned char base=DEC){format(base==HEX?"%x":"%d",v);}
+  String(unsigned int v,unsigned char base=DEC){format(base==HEX?"%x":"%u",v);}
+  String(long v,unsigned char base=DEC){format(base==HEX?"%lx":"%ld",v);}
+  String(unsigned long v,unsigned char base=DEC){format(base==HEX?"%lx":"%lu",v);}
+  String(long long v,unsigned char base=DEC){format(base==HEX?"%llx":"%lld",v);}
+  String(unsigned long long v,unsigned char base=DEC){format(base==HEX?"%llx":"%llu",v);}
+  String(double v,unsigned char decimals=2){format("%.*f",(int)decimals,v);}
+  
+  unsigned int length()const{return str.size();}
+  const char*c_str()const{return str.c_str();}
+  bool reserve(unsigned int size){str.reserve(size);return true;}
+  long toInt()const{return atol(str.c_str());}
+  char operator[](unsigned int i)const{return str[i];}
+  bool operator==(const String&o)const{return str==o.str;}
+  bool operator==(const char*o)const{return str==o;}
+  bool operator!=(const String&o)const{return str!=o.str;}
+  String&operator+=(const String&o){str+=o.str;return *this;}
+  String&operator+=(const char*o){str+=o;return *this;}
+  String&operator+=(char c){str+=c;return *this;}
+  bool concat(const char*s,unsigned int n){str.append(s,n);return true;}
+  bool startsWith(const String&p)const{return str.compare(0,p.str.size(),p.str)==0;}
+  bool endsWith(const String&p)const{return str.size()>=p.str.size()&&str.compare(str.size()-p.str.size(),p.str.size(),p.str)==0;}
+  void trim(){
+    size_t a=str.find_first_not_of(" \t\r\n");
+    size_t b=str.find_last_not_of(" \t\r\n");
+    str=(a==std::string::npos)?std::string():str.substr(a,b-a+1);
+  }
+  
+  friend String operator+(const String&a,const String&b){return String(a.str+b.str);}
+  friend String operator+(const String&a,const char*b){return String(a.str+b);}
+  friend String operator+(const char*a,const String&b){return String(a+b.str);}
+private:
+  template<typename T> void format(const char*fmt,T v){
+    char buf[32];
+    snprintf(buf,sizeof(buf),fmt,v);
+    str=buf;
+  }
+  template<typename T> void format(const char*fmt,int prec,T v){
+    char buf[64];
+    snprintf(buf,sizeof(buf),fmt,prec,v);
+    str=buf;
+  }
+  std::string str;
+};
+
+class Print{
+public:
+  virtual ~Print(){}
+  virtual size_t write(uint8_t c)=0;
+  virtual size_t write(const uint8_t*buf,size_t len){
+    size_t n=0;
+    while(len--&&write(*buf++))n++;
+    return n;
+  }
+  virtual void flush(){}
+  size_t write(const char*s){return write((const uint8_t*)s,strlen(s));}
+  
+  size_t print(const char*s){return write(s);}
+  size_t print(const String&s){return write((const uint8_t*)s.c_str(),s.length());}
+  size_t print(char c){return write((uint8_t)c);}
+  size_t print(int v,int base=DEC){return print(String(v,base));}
+  size_t print(unsigned int v,int base=DEC){return print(String(v,base));}
+  size_t print(long v,int base=DEC){return print(String(v,base));}
+  size_t print(unsigned long v,int base=DEC){return print(String(v,base));}
+  size_t print(long long v,int base=DEC){return print(String(v,base));}
+  size_t print(unsigned long long v,int base=DEC){return print(String(v,base));}
+  size_t print(double v,int decimals=2){return print(String(v,decimals));}
+  template<typename T> size_t println(const T&v){return print(v)+print("\r\n");}
+  size_t println(){return print("\r\n");}
+};
+
+class Stream:public Print{
+public:
+  virtual int available()=0;
+  virtual int read()=0;
+  size_t readBytesUntil(char terminator,char*buf,size_t len){
+    size_t n=0;
+    while(n<len){
+      int c=read();
+      if(c<0||c==terminator)break;
+      buf[n++]=(char)c;
+    }
+    return n;
+  }
+  String readString(){
+    String s;
+    int c;
+    while((c=read())>=0)s+=(char)c;
+    return s;
+  }
+};
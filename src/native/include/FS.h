@@ -0,0 +1,106 @@
+#pragma once
+// Directory-backed stand-in for the Arduino fs::FS / fs::File API, so the
+// core's file handling runs unchanged on a workstation.
+#include <Arduino.h>
+#include <memory>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs{
+
+enum SeekMode{SeekSet=0,SeekCur=1,SeekEnd=2};
+
+struct FSInfo{
+  size_t totalBytes;
+  size_t usedBytes;
+  size_t blockSize;
+  size_t pageSize;
+  size_t maxOpenFiles;
+  size_t maxPathLength;
+};
+
+class File:public Stream{
+public:
+  File(){}
+  explicit File(FILE*f):fp(f,fclose){}
+  
+  size_t write(uint8_t c)override{return fp&&fputc(c,fp.get())!=EOF?1:0;}
+  size_t write(const uint8_t*buf,size_t len)override{return fp?fwrite(buf,1,len,fp.get()):0;}
+  using Print::write;
+  int read()override{return fp?fgetc(fp.get()):-1;}
+  size_t read(uint8_t*buf,size_t len){return fp?fread(buf,1,len,fp.get()):0;}
+  int available()override{return fp?(int)(size()-position()):0;}
+  bool seek(uint32_t pos,SeekMode mode=SeekSet){
+    static const int whence[]={SEEK_SET,SEEK_CUR,SEEK_END};
+    return fp&&fseek(fp.get(),pos,whence[mode])==0;
+  }
+  size_t position()const{return fp?ftell(fp.get()):0;}
+  size_t size()const{
+    if(!fp)return 0;
+    fflush(fp.get());
+    struct stat st;
+    return fstat(fileno(fp.get()),&st)==0?st.st_size:0;
+  }
+  bool truncate(uint32_t size){
+    if(!fp)return false;
+    fflush(fp.get());
+    return ftruncate(fileno(fp.get()),size)==0;
+  }
+  void flush()override{if(fp)fflush(fp.get());}
+  void close(){fp.reset();}
+  operator bool()const{return (bool)fp;}
+private:
+  std::shared_ptr<FILE>fp;
+};
+
+class FS{
+public:
+  explicit FS(const std::string&rootDir):root(rootDir){}
+  
+  File open(const char*path,const char*mode){
+    std::string m=mode;
+    if(m!="r")makeParents(path);
+    std::string bm=(m=="r+")?"r+b":(m=="w+")?"w+b":(m=="a+")?"a+b":m+"b";
+    FILE*f=fopen(hostPath(path).c_str(),bm.c_str());
+    return f?File(f):File();
+  }
+  File open(const String&path,const char*mode){return open(path.c_str(),mode);}
+  bool exists(const char*path){
+    struct stat st;
+    return stat(hostPath(path).c_str(),&st)==0;
+  }
+  bool exists(const String&path){return exists(path.c_str());}
+  bool remove(const char*path){return ::remove(hostPath(path).c_str())==0;}
+  bool remove(const String&path){return remove(path.c_str());}
+  bool rename(const char*from,const char*to){return ::rename(hostPath(from).c_str(),hostPath(to).c_str())==0;}
+  bool rename(const String&from,const String&to){return rename(from.c_str(),to.c_str());}
+  bool mkdir(const char*path){return ::mkdir(hostPath(path).c_str(),0755)==0;}
+  bool mkdir(const String&path){return mkdir(path.c_str());}
+  bool rmdir(const char*path){return ::rmdir(hostPath(path).c_str())==0;}
+  bool rmdir(const String&path){return rmdir(path.c_str());}
+  bool info(FSInfo&info){
+    memset(&info,0,sizeof(info));
+    return true;
+  }
+  const std::string&rootDir()const{return root;}
+private:
+  std::string hostPath(const char*path)const{return root+path;}
+  // LittleFS creates intermediate directories on open-for-write
+  void makeParents(const char*path){
+    std::string p=path;
+    for(size_t i=1;i<p.size();i++){
+      if(p[i]=='/')::mkdir(hostPath(p.substr(0,i).c_str()).c_str(),0755);
+    }
+  }
+  std::string root;
+};
+
+}
+
+using fs::File;
+using fs::FSInfo;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
+using fs::SeekMode;
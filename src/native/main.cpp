@@ -0,0 +1,189 @@
+// Native replay tool: feeds a downloaded log (/api/log.raw or the CSV from
+// /api/log?format=csv) through the same logging and statistics code the
+// device runs, then times the stats paths. "bench" runs the benchmark
+// suite instead (see bench.h). "supply" replays a recorded supply
+// waveform, one millivolt value per line at SUPPLY_RATE_HZ, through the
+// sampling pipeline (see supply.h) and lists the events it logs.
+//
+//   .pio/build/native/program <power_log.bin|log.csv> [workdir]
+//   .pio/build/native/program bench [100,1000,...] [workdir]
+//   .pio/build/native/program supply <waveform.txt> [workdir]
+//
+// Left out of "pio test -e native" builds, whose tests (test/) bring
+// their own main().
+#ifndef PIO_UNIT_TESTING
+#include <chrono>
+#include <cmath>
+#include <string>
+#include "../bench.h"
+#include "../powerlog.h"
+#include "../supply.h"
+#include "hal_native.h"
+
+static bool loadBinary(const char*path,std::vector<LogRecord>&out){
+  FILE*f=fopen(path,"rb");
+  if(!f)return false;
+  LogHeader h;
+  bool ok=fread(&h,sizeof(h),1,f)==1&&h.magic==LOG_MAGIC&&h.recordSize==sizeof(LogRecord);
+  LogRecord r;
+  while(ok&&fread(&r,sizeof(r),1,f)==1)out.push_back(r);
+  fclose(f);
+  return ok;
+}
+
+// Columns: index,type,timestamp,duration,cause (header line skipped)
+static bool loadCsv(const char*path,std::vector<LogRecord>&out){
+  FILE*f=fopen(path,"r");
+  if(!f)return false;
+  char line[128],type[16];
+  unsigned long index,ts,dur;
+  unsigned cause;
+  while(fgets(line,sizeof(line),f)){
+    if(sscanf(line,"%lu,%15[^,],%lu,%lu,%u",&index,type,&ts,&dur,&cause)<4)continue;
+    LogRecord r;
+    std::string t=type;
+    r.type=(t=="ON")?EV_ON:(t=="OFF")?EV_OFF:(t=="SAG")?EV_SAG:(t=="SWELL")?EV_SWELL:EV_RESTART;
+    if(EV_HAS_CAUSE(r.type))r.type|=(uint8_t)(cause<<4);
+    r.timestamp=ts;
+    r.duration=dur;
+    out.push_back(r);
+  }
+  fclose(f);
+  return true;
+}
+
+template<typename F> static double timeMs(F fn){
+  auto t0=std::chrono::steady_clock::now();
+  fn();
+  return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-t0).count();
+}
+
+static void printWindow(const char*name,time_t off,time_t on){
+  printf("  %-8s off %-16s on %s\n",name,formatDuration(off).c_str(),formatDuration(on).c_str());
+}
+
+static int bench(int argc,char**argv){
+  size_t sizes[BENCH_MAX_SIZES];
+  size_t count=parseBenchSizes(argc>2?argv[2]:"",sizes,BENCH_MAX_SIZES);
+  mountNativeFs(argc>3?argv[3]:"bench_fs");
+  loadSegments();
+  fakeClock.set(1767225600); // 2026-01-01, a fixed point so runs compare
+  StdoutPrint out;
+  runBenchmarks(out,"native",sizes,count);
+  return 0;
+}
+
+// Samples are pushed as the timer would, and polled every
+// SUPPLY_POLL_INTERVAL of waveform time, with the clock following along.
+static int supply(int argc,char**argv){
+  FILE*f=argc>2?fopen(argv[2],"r"):nullptr;
+  if(!f){
+    fprintf(stderr,"cannot read %s\n",argc>2?argv[2]:"(no waveform)");
+    return 1;
+  }
+  double mv;
+  while(fscanf(f,"%lf",&mv)==1){
+    long raw=lround(mv*1023/SUPPLY_FULL_SCALE_MV);
+    replayAdc.samples.push_back((uint16_t)std::min(std::max(raw,0L),1023L));
+  }
+  fclose(f);
+  mountNativeFs(argc>3?argv[3]:"supply_fs");
+  loadSegments();
+  clearLog();
+  resetSupply();
+  const time_t start=1767225600;
+  const size_t perPoll=SUPPLY_RATE_HZ*SUPPLY_POLL_INTERVAL/1000;
+  size_t n=replayAdc.samples.size();
+  double pollMs=0;
+  for(size_t i=0;i<n;i++){
+    fakeClock.wall=start+(time_t)(i/SUPPLY_RATE_HZ);
+    fakeClock.ms=(uint32_t)(i*1000/SUPPLY_RATE_HZ);
+    supplySample();
+    if((i+1)%perPoll==0||i+1==n){
+      pollMs+=timeMs([](){supplyPoll(true);});
+    }
+  }
+  const SupplyStatus&st=supplyStatus();
+  printf("%zu samples (%.1f s), %u sags, %u swells, %u overruns, %u missed\n",n,(double)n/SUPPLY_RATE_HZ,
+    (unsigned)st.sags,(unsigned)st.swells,(unsigned)st.overruns,(unsigned)st.missed);
+  printf("supplyPoll        %8.3f ms total, %.2f us per sample\n",pollMs,n?pollMs*1000/n:0.0);
+  LogReader reader;
+  LogRecord r;
+  if(reader.open()){
+    while(reader.next(r))printf("  %-5s %s for %s\n",eventLabel(r.type),getTimeString(r.timestamp).c_str(),formatDuration(r.duration).c_str());
+    reader.close();
+  }
+  return 0;
+}
+
+int main(int argc,char**argv){
+  if(argc<2){
+    fprintf(stderr,"usage: %s <power_log.bin|log.csv> [workdir]\n"
+      "       %s bench [sizes] [workdir]\n"
+      "       %s supply <waveform.txt> [workdir]\n",argv[0],argv[0],argv[0]);
+    return 2;
+  }
+  // Same fixed UTC+6 offset the device passes to configTime()
+  setenv("TZ","<+06>-6",1);
+  tzset();
+  resetCalendarCache();
+  std::string in=argv[1];
+  if(in=="bench")return bench(argc,argv);
+  if(in=="supply")return supply(argc,argv);
+  std::vector<LogRecord>records;
+  bool csv=in.size()>4&&in.compare(in.size()-4,4,".csv")==0;
+  if(!(csv?loadCsv(argv[1],records):loadBinary(argv[1],records))){
+    fprintf(stderr,"cannot read %s\n",argv[1]);
+    return 1;
+  }
+  mountNativeFs(argc>2?argv[2]:"replay_fs");
+  loadSegments();
+  clearLog();
+  
+  double replayMs=timeMs([&](){
+    for(const LogRecord&r:records){
+      fakeClock.set(r.timestamp);
+      logEvent(r.type,r.timestamp,r.duration);
+    }
+  });
+  printf("replayed %zu records in %.1f ms\n",records.size(),replayMs);
+  if(records.empty())return 0;
+  
+  Stats s;
+  std::vector<LogEntry>entries;
+  double statsMs=timeMs([&](){s=calculateStats();});
+  double parseMs=timeMs([&](){entries=parseLog();});
+  double rebuildMs=timeMs([&](){rebuildAggregates();});
+  OutageStats o;
+  double outageMs=timeMs([&](){o=calculateOutageStats();});
+  // The retained log as an archive, to compare its size and decode time
+  archiveLogRecords(logFirst(),logTotal());
+  size_t decoded=0;
+  double archiveMs=timeMs([&](){
+    ArchiveReader reader;
+    LogRecord r;
+    if(!reader.open())return;
+    while(reader.next(r))decoded++;
+    reader.close();
+  });
+  
+  printf("stats at %s\n",getTimeString(fakeClock.now()).c_str());
+  printWindow("today",s.todayOff,s.todayOn);
+  printWindow("7 days",s.last7Off,s.last7On);
+  printWindow("15 days",s.last15Off,s.last15On);
+  printWindow("month",s.monthOff,s.monthOn);
+  printf("  %zu outages, median %s, p95 %s, longest %s at %s, MTBF %s\n",(size_t)o.outages,
+    formatDuration(o.percentile(50)).c_str(),formatDuration(o.percentile(95)).c_str(),
+    formatDuration(o.maxOff).c_str(),getTimeString(o.longestAt).c_str(),formatDuration(o.mtbf()).c_str());
+  printf("calculateStats    %8.3f ms\n",statsMs);
+  printf("outage analytics  %8.3f ms\n",outageMs);
+  printf("parseLog          %8.3f ms (%zu entries)\n",parseMs,entries.size());
+  printf("rebuildAggregates %8.3f ms\n",rebuildMs);
+  printf("archive decode    %8.3f ms (%zu entries)\n",archiveMs,decoded);
+  printf("archive           %zu bytes for %zu records (%.1f bytes per record)\n",archiveBytes(),decoded,
+    decoded?(double)archiveBytes()/decoded:0.0);
+  printf("%zu segments, %zu bytes, records %zu-%zu\n",segments.size(),logBytes(),logFirst(),logTotal());
+  return 0;
+}
+
+#endif
@@ -0,0 +1,1480 @@
+#include "powerlog.h"
+#include <algorithm>
+
+String logDir="/log";
+String legacyFlatLogFile="/power_log.bin";
+String legacyLogFile="/power_log.txt";
+String heartbeatFile="/heartbeat.bin";
+String legacyLastOnFile="/last_on.txt";
+String aggFile="/power_stats.bin";
+
+struct __attribute__((packed)) AggHeader{
+  uint32_t magic;
+  uint8_t version;
+  uint8_t days;
+  uint16_t reserved;
+  uint32_t recordCount;
+  uint32_t crc;
+};
+
+struct __attribute__((packed)) ManifestHeader{
+  uint32_t magic;
+  uint8_t version;
+  uint8_t count;
+  uint16_t reserved;
+  uint32_t crc; // of the entries
+};
+
+struct __attribute__((packed)) ManifestEntry{
+  uint32_t month;
+  uint32_t base;
+};
+
+DayBucket dayBuckets[AGG_DAYS];
+uint32_t aggRecordCount=0;
+
+std::vector<Segment>segments;
+uint8_t retentionMonths=RETENTION_MONTHS;
+uint32_t retentionBytes=0; // 0 = no byte budget
+uint32_t archiveBudget=ARCHIVE_MAX_BYTES;
+uint32_t logGeneration=0;
+
+// Writers only touch the store's RAM copy; callers commit, so a whole
+// config save is a single sector write.
+void saveString(int addr,const String&s,int maxLen){
+  for(int i=0;i<maxLen;i++)hal.kv->write(addr+i,(i<(int)s.length())?s[i]:0);
+}
+
+String readString(int addr,int maxLen){
+  char buf[maxLen+1];
+  for(int i=0;i<maxLen;i++)buf[i]=hal.kv->read(addr+i);
+  buf[maxLen]=0;
+  return String(buf);
+}
+
+// Unset EEPROM reads 0xFF: keep the defaults then.
+void loadRetention(){
+  uint8_t months=hal.kv->read(RETENTION_ADDR);
+  uint16_t kb=hal.kv->read(RETENTION_ADDR+1)|(hal.kv->read(RETENTION_ADDR+2)<<8);
+  retentionMonths=(months==0||months==0xFF)?RETENTION_MONTHS:months;
+  retentionBytes=(kb==0xFFFF)?0:(uint32_t)kb*1024;
+}
+
+void saveRetention(){
+  uint16_t kb=retentionBytes/1024;
+  hal.kv->write(RETENTION_ADDR,retentionMonths);
+  hal.kv->write(RETENTION_ADDR+1,kb&0xFF);
+  hal.kv->write(RETENTION_ADDR+2,kb>>8);
+}
+
+// Local calendar day of the last timestamp looked up. Log records come
+// in time order, so consecutive lookups nearly always land on the same
+// day and skip localtime()/mktime().
+struct CalendarDay{
+  time_t start; // local midnight
+  time_t end; // next local midnight
+  int32_t day;
+  uint32_t month;
+  char date[11]; // "YYYY-MM-DD"
+};
+
+static CalendarDay calDay={0,0,0,0,""};
+uint32_t calendarLookups=0;
+
+// Stats window starts; today and the month start only move at midnight
+static time_t statsDayStart=0,statsDayEnd=0,statsMonthStart=0;
+
+void resetCalendarCache(){
+  calDay.start=calDay.end=0;
+  statsDayStart=statsDayEnd=0;
+}
+
+static int32_t civilDay(int y,int m,int d){
+  y-=m<=2;
+  int era=(y>=0?y:y-399)/400;
+  unsigned yoe=y-era*400;
+  unsigned doy=(153*(m+(m>2?-3:9))+2)/5+d-1;
+  unsigned doe=yoe*365+yoe/4-yoe/100+doy;
+  return era*146097+(int32_t)doe-719468;
+}
+
+static const CalendarDay&calendarDay(time_t t){
+  if(t>=calDay.start&&t<calDay.end)return calDay;
+  calendarLookups++;
+  struct tm tm=*localtime(&t);
+  calDay.day=civilDay(tm.tm_year+1900,tm.tm_mon+1,tm.tm_mday);
+  calDay.month=tm.tm_year*12+tm.tm_mon;
+  strftime(calDay.date,sizeof(calDay.date),"%Y-%m-%d",&tm);
+  tm.tm_hour=tm.tm_min=tm.tm_sec=0;
+  tm.tm_isdst=-1;
+  calDay.start=std::min(mktime(&tm),t);
+  tm.tm_mday++;
+  tm.tm_isdst=-1;
+  calDay.end=std::max(mktime(&tm),t+1);
+  return calDay;
+}
+
+const char*formatTime(time_t t,char*buf){
+  if(t<=0)return strcpy(buf,"N/A");
+  const CalendarDay&c=calendarDay(t);
+  memcpy(buf,c.date,10);
+  if(c.end-c.start==86400){
+    uint32_t sec=t-c.start;
+    uint8_t f[3]={(uint8_t)(sec/3600),(uint8_t)(sec/60%60),(uint8_t)(sec%60)};
+    for(int i=0;i<3;i++){
+      buf[10+i*3]=i?':':' ';
+      buf[11+i*3]='0'+f[i]/10;
+      buf[12+i*3]='0'+f[i]%10;
+    }
+    buf[19]=0;
+  }else{
+    // DST change today: wall-clock time is not an offset from midnight
+    strftime(buf+10,TIME_TEXT_LEN-10," %H:%M:%S",localtime(&t));
+  }
+  return buf;
+}
+
+const char*formatDuration(time_t s,char*buf){
+  if(s<=0)return strcpy(buf,"0s");
+  unsigned days=s/86400;s%=86400;
+  unsigned h=s/3600;s%=3600;
+  unsigned m=s/60;unsigned sec=s%60;
+  if(days)snprintf(buf,DURATION_TEXT_LEN,"%ud %uh %um %us",days,h,m,sec);
+  else if(h)snprintf(buf,DURATION_TEXT_LEN,"%uh %um %us",h,m,sec);
+  else if(m)snprintf(buf,DURATION_TEXT_LEN,"%um %us",m,sec);
+  else snprintf(buf,DURATION_TEXT_LEN,"%us",sec);
+  return buf;
+}
+
+String getTimeString(time_t t){
+  char buf[TIME_TEXT_LEN];
+  return String(formatTime(t,buf));
+}
+
+String formatDuration(time_t s){
+  char buf[DURATION_TEXT_LEN];
+  return String(formatDuration(s,buf));
+}
+
+void printTime(Print&out,time_t t){
+  char buf[TIME_TEXT_LEN];
+  out.print(formatTime(t,buf));
+}
+
+void printDuration(Print&out,time_t s){
+  char buf[DURATION_TEXT_LEN];
+  out.print(formatDuration(s,buf));
+}
+
+static uint8_t logRecordSize(uint8_t version){
+  return version==1?sizeof(LogRecord):sizeof(LogFrame);
+}
+
+uint8_t logFileVersion(File&f){
+  LogHeader h;
+  if(f.size()<sizeof(h))return 0;
+  f.seek(0,SeekSet);
+  if(f.read((uint8_t*)&h,sizeof(h))!=sizeof(h))return 0;
+  if(h.magic!=LOG_MAGIC||(h.version!=1&&h.version!=LOG_VERSION))return 0;
+  return h.recordSize==logRecordSize(h.version)?h.version:0;
+}
+
+bool readLogHeader(File&f){
+  return logFileVersion(f)==LOG_VERSION;
+}
+
+static bool writeLogHeaderTo(Print&out,uint8_t version){
+  LogHeader h;
+  h.magic=LOG_MAGIC;
+  h.version=version;
+  h.recordSize=logRecordSize(version);
+  h.reserved=0;
+  return out.write((const uint8_t*)&h,sizeof(h))==sizeof(h);
+}
+
+bool writeLogHeader(File&f,uint8_t version){
+  return writeLogHeaderTo(f,version);
+}
+
+size_t logRecordCount(File&f){
+  return (f.size()-sizeof(LogHeader))/sizeof(LogFrame);
+}
+
+void makeLogFrame(const LogRecord&r,LogFrame&fr){
+  fr.len=sizeof(LogRecord);
+  fr.rec=r;
+  fr.crc=crc32Update(0,(const uint8_t*)&fr,offsetof(LogFrame,crc))&0xFFFF;
+  fr.commit=LOG_COMMIT;
+}
+
+bool logFrameValid(const LogFrame&fr){
+  return fr.commit==LOG_COMMIT&&fr.len==sizeof(LogRecord)
+    &&fr.crc==(crc32Update(0,(const uint8_t*)&fr,offsetof(LogFrame,crc))&0xFFFF);
+}
+
+void toLogEntry(const LogRecord&r,LogEntry&e){
+  e.type=r.type;
+  e.timestamp=r.timestamp;
+  e.duration=r.duration;
+}
+
+bool LogReader::open(){
+  if(segments.empty())return false;
+  first=logFirst();
+  total=count=logTotal();
+  bufLen=bufPos=0;
+  return openSegment(0,first);
+}
+
+// Opens segment i positioned at global record at (clamped to the segment).
+bool LogReader::openSegment(size_t i,size_t at){
+  f.close();
+  seg=i;
+  if(i>=segments.size())return false;
+  const Segment&s=segments[i];
+  index=std::max(at,(size_t)s.base);
+  f=hal.fs->open(segmentPath(s.month),"r");
+  if(!f)return false;
+  return f.seek(sizeof(LogHeader)+(index-s.base)*sizeof(LogFrame),SeekSet);
+}
+
+void LogReader::range(size_t from,size_t to){
+  count=std::min(to,total);
+  from=std::min(std::max(from,first),count);
+  bufLen=bufPos=0;
+  size_t i=segments.size();
+  while(i>1&&segments[i-1].base>from)i--;
+  openSegment(i-1,from);
+}
+
+// Loops over corrupt frames rather than recursing, so a long damaged run
+// cannot grow the stack
+bool LogReader::next(LogRecord&r){
+  for(;;){
+    if(bufPos==bufLen){
+      if(index>=count||seg>=segments.size())return false;
+      // Move on to the next segment at the end of this one
+      while(index>=segments[seg].base+segments[seg].count){
+        if(seg+1>=segments.size()||!openSegment(seg+1,index))return false;
+        if(index>=count)return false;
+      }
+      size_t segEnd=segments[seg].base+segments[seg].count;
+      size_t want=std::min(std::min(count,segEnd)-index,sizeof(buf)/sizeof(buf[0]));
+      bufLen=f.read((uint8_t*)buf,want*sizeof(LogFrame))/sizeof(LogFrame);
+      bufPos=0;
+      if(bufLen==0)return false;
+    }
+    const LogFrame&fr=buf[bufPos++];
+    index++;
+    if(!logFrameValid(fr)){
+      corrupt++;
+      continue;
+    }
+    r=fr.rec;
+    return true;
+  }
+}
+
+void LogReader::close(){
+  f.close();
+}
+
+uint32_t readLogTimestamp(File&f,size_t index){
+  LogFrame fr;
+  f.seek(sizeof(LogHeader)+index*sizeof(LogFrame),SeekSet);
+  if(f.read((uint8_t*)&fr,sizeof(fr))!=sizeof(fr))return 0;
+  return fr.rec.timestamp;
+}
+
+String segmentPath(uint32_t month){
+  char name[24];
+  snprintf(name,sizeof(name),"/%04u%02u.bin",(unsigned)(month/12+1900),(unsigned)(month%12+1));
+  return logDir+name;
+}
+
+size_t logFirst(){
+  return segments.empty()?0:segments.front().base;
+}
+
+size_t logTotal(){
+  return segments.empty()?0:segments.back().base+segments.back().count;
+}
+
+size_t logBytes(){
+  size_t bytes=0;
+  for(const Segment&s:segments)bytes+=sizeof(LogHeader)+s.count*sizeof(LogFrame);
+  return bytes;
+}
+
+bool readManifest(const String&path){
+  File f=hal.fs->open(path,"r");
+  if(!f)return false;
+  ManifestHeader h;
+  ManifestEntry e[MANIFEST_MAX];
+  bool ok=f.read((uint8_t*)&h,sizeof(h))==sizeof(h)&&h.magic==MANIFEST_MAGIC&&h.version==MANIFEST_VERSION&&h.count<=MANIFEST_MAX
+    &&f.read((uint8_t*)e,h.count*sizeof(ManifestEntry))==h.count*sizeof(ManifestEntry)
+    &&h.crc==crc32Update(0,(const uint8_t*)e,h.count*sizeof(ManifestEntry));
+  f.close();
+  if(!ok)return false;
+  segments.clear();
+  for(uint8_t i=0;i<h.count;i++){
+    Segment s;
+    s.month=e[i].month;
+    s.base=e[i].base;
+    s.count=0;
+    s.firstTs=0;
+    segments.push_back(s);
+  }
+  return true;
+}
+
+// Written to a temporary file first; loadSegments() falls back to it if
+// power drops between the remove and the rename.
+void saveManifest(){
+  ManifestHeader h;
+  ManifestEntry e[MANIFEST_MAX];
+  h.magic=MANIFEST_MAGIC;
+  h.version=MANIFEST_VERSION;
+  h.count=std::min(segments.size(),(size_t)MANIFEST_MAX);
+  h.reserved=0;
+  for(uint8_t i=0;i<h.count;i++){
+    e[i].month=segments[i].month;
+    e[i].base=segments[i].base;
+  }
+  h.crc=crc32Update(0,(const uint8_t*)e,h.count*sizeof(ManifestEntry));
+  String path=logDir+"/manifest.bin";
+  String tmp=path+".tmp";
+  File f=hal.fs->open(tmp,"w");
+  if(!f)return;
+  bool ok=f.write((const uint8_t*)&h,sizeof(h))==sizeof(h)
+    &&f.write((const uint8_t*)e,h.count*sizeof(ManifestEntry))==h.count*sizeof(ManifestEntry);
+  f.close();
+  if(!ok)return;
+  hal.fs->remove(path);
+  hal.fs->rename(tmp,path);
+}
+
+// Rewrites a version 1 segment (bare records) as journal frames. The old
+// file is removed only once the new one is complete; loadSegments()
+// finishes the rename if power drops in between.
+bool upgradeSegment(const String&path){
+  File in=hal.fs->open(path,"r");
+  if(!in)return false;
+  String tmp=path+".tmp";
+  File out=hal.fs->open(tmp,"w");
+  bool ok=out&&logFileVersion(in)==1&&writeLogHeader(out);
+  LogRecord batch[16];
+  LogFrame frames[16];
+  size_t n;
+  while(ok&&(n=in.read((uint8_t*)batch,sizeof(batch))/sizeof(LogRecord))>0){
+    for(size_t i=0;i<n;i++)makeLogFrame(batch[i],frames[i]);
+    ok=out.write((const uint8_t*)frames,n*sizeof(LogFrame))==n*sizeof(LogFrame);
+  }
+  in.close();
+  if(out)out.close();
+  if(!ok){
+    hal.fs->remove(tmp);
+    return false;
+  }
+  hal.fs->remove(path);
+  return hal.fs->rename(tmp,path);
+}
+
+// Cuts a torn tail off the newest segment: a partial frame, then up to
+// LOG_RECOVERY_FRAMES trailing frames that fail the CRC or commit check.
+// Only the tail is read, so this takes the same time for any log size;
+// a bad frame further back is skipped by LogReader instead.
+size_t recoverLogTail(File&f){
+  size_t size=f.size();
+  size_t count=logRecordCount(f);
+  size_t checked=0;
+  LogFrame fr;
+  while(count>0&&checked++<LOG_RECOVERY_FRAMES){
+    f.seek(sizeof(LogHeader)+(count-1)*sizeof(LogFrame),SeekSet);
+    if(f.read((uint8_t*)&fr,sizeof(fr))==sizeof(fr)&&logFrameValid(fr))break;
+    count--;
+  }
+  size_t keep=sizeof(LogHeader)+count*sizeof(LogFrame);
+  if(keep!=size&&f.truncate(keep)){
+    hal.console->println("Log recovery: dropped "+String(size-keep)+" torn bytes");
+  }
+  return count;
+}
+
+// Reads the manifest, then sizes each segment from its file. Only the
+// retained segments are opened, so boot cost follows the retention budget.
+void loadSegments(){
+  String path=logDir+"/manifest.bin";
+  if(!readManifest(path)&&!readManifest(path+".tmp")){
+    segments.clear();
+    return;
+  }
+  bool dropped=false;
+  for(size_t i=0;i<segments.size();){
+    Segment&s=segments[i];
+    String segPath=segmentPath(s.month);
+    if(!hal.fs->exists(segPath)&&hal.fs->exists(segPath+".tmp"))hal.fs->rename(segPath+".tmp",segPath);
+    bool newest=i+1==segments.size();
+    File f=hal.fs->open(segPath,newest?"r+":"r");
+    uint8_t version=f?logFileVersion(f):0;
+    if(version==1){
+      f.close();
+      if(upgradeSegment(segPath)){
+        f=hal.fs->open(segPath,newest?"r+":"r");
+        version=f?logFileVersion(f):0;
+      }
+    }
+    if(version==LOG_VERSION){
+      s.count=newest?recoverLogTail(f):logRecordCount(f);
+      s.firstTs=s.count?readLogTimestamp(f,0):0;
+      f.close();
+      i++;
+      continue;
+    }
+    if(f)f.close();
+    segments.erase(segments.begin()+i);
+    dropped=true;
+  }
+  if(dropped)saveManifest();
+}
+
+// Global index of the first record with timestamp>=t (logTotal() if there
+// is none). The manifest picks the segment, then only that file is
+// binary-searched; the log is appended in time order.
+size_t findLogRecord(time_t t){
+  size_t i=segments.size();
+  while(i>0&&(segments[i-1].count==0||(time_t)segments[i-1].firstTs>t))i--;
+  if(i==0)return logFirst();
+  const Segment&s=segments[i-1];
+  File f=hal.fs->open(segmentPath(s.month),"r");
+  if(!f)return s.base;
+  size_t lo=0,hi=s.count;
+  while(lo<hi){
+    size_t mid=(lo+hi)/2;
+    if((time_t)readLogTimestamp(f,mid)<t)lo=mid+1;
+    else hi=mid;
+  }
+  f.close();
+  return s.base+lo;
+}
+
+bool startSegment(uint32_t month){
+  Segment s;
+  s.month=month;
+  s.base=logTotal();
+  s.count=0;
+  s.firstTs=0;
+  File f=hal.fs->open(segmentPath(month),"w");
+  if(!f)return false;
+  bool ok=writeLogHeader(f);
+  f.close();
+  if(!ok)return false;
+  segments.push_back(s);
+  saveManifest();
+  applyRetention();
+  return true;
+}
+
+size_t appendLogRecords(const LogRecord*recs,size_t n){
+  size_t written=0;
+  while(written<n){
+    uint32_t month=monthNumber(recs[written].timestamp);
+    if(segments.empty()||month>segments.back().month){
+      if(!startSegment(month))break;
+    }
+    Segment&s=segments.back();
+    // Up to the next month change, in batches of 16 frames
+    size_t run=1;
+    while(written+run<n&&monthNumber(recs[written+run].timestamp)<=s.month)run++;
+    File f=hal.fs->open(segmentPath(s.month),"a");
+    if(!f)break;
+    // Drop a partial frame left by an earlier failed write
+    size_t end=sizeof(LogHeader)+s.count*sizeof(LogFrame);
+    if(f.size()!=end)f.truncate(end);
+    LogFrame frames[16];
+    run=std::min(run,sizeof(frames)/sizeof(frames[0]));
+    for(size_t i=0;i<run;i++)makeLogFrame(recs[written+i],frames[i]);
+    size_t ok=f.write((const uint8_t*)frames,run*sizeof(LogFrame))/sizeof(LogFrame);
+    f.close();
+    if(s.count==0&&ok)s.firstTs=recs[written].timestamp;
+    s.count+=ok;
+    written+=ok;
+    if(ok<run)break;
+  }
+  if(written)logGeneration++;
+  return written;
+}
+
+// Appends daily summaries for the days of s not already summarised, so
+// compacting the same segment twice (power lost mid-eviction) is harmless.
+void compactSegment(const Segment&s){
+  String path=logDir+"/daily.bin";
+  int32_t lastDay=INT32_MIN;
+  File f=hal.fs->open(path,"r");
+  bool valid=false;
+  if(f){
+    LogHeader h;
+    valid=f.read((uint8_t*)&h,sizeof(h))==sizeof(h)&&h.magic==DAILY_MAGIC&&h.version==DAILY_VERSION&&h.recordSize==sizeof(DaySummary);
+    size_t n=valid?(f.size()-sizeof(h))/sizeof(DaySummary):0;
+    DaySummary d;
+    if(n>0&&f.seek(sizeof(h)+(n-1)*sizeof(DaySummary),SeekSet)&&f.read((uint8_t*)&d,sizeof(d))==sizeof(d))lastDay=d.day;
+    f.close();
+  }
+  f=hal.fs->open(path,valid?"a":"w");
+  if(!f)return;
+  if(!valid){
+    LogHeader h;
+    h.magic=DAILY_MAGIC;
+    h.version=DAILY_VERSION;
+    h.recordSize=sizeof(DaySummary);
+    h.reserved=0;
+    f.write((const uint8_t*)&h,sizeof(h));
+  }
+  LogReader reader;
+  LogRecord r;
+  DaySummary d;
+  d.day=INT32_MIN;
+  if(reader.open()){
+    reader.range(s.base,s.base+s.count);
+    while(reader.next(r)){
+      int32_t day=dayNumber(r.timestamp);
+      if(day<=lastDay)continue;
+      if(day!=d.day){
+        if(d.day!=INT32_MIN)f.write((const uint8_t*)&d,sizeof(d));
+        d.day=day;
+        d.off=d.on=0;
+        d.outages=d.restarts=0;
+      }
+      if(EV_KIND(r.type)==EV_OFF){
+        d.off+=r.duration;
+        d.outages++;
+      }else if(EV_KIND(r.type)==EV_ON)d.on+=r.duration;
+      else if(EV_KIND(r.type)==EV_RESTART)d.restarts++;
+      lastDay=std::max(lastDay,day-1); // ignore out-of-order stragglers
+    }
+    reader.close();
+  }
+  if(d.day!=INT32_MIN)f.write((const uint8_t*)&d,sizeof(d));
+  f.close();
+}
+
+String archivePath(){
+  return logDir+"/archive.bin";
+}
+
+// Finishes a trim that lost power between the remove and the rename.
+static File openArchive(const char*mode){
+  String path=archivePath();
+  if(!hal.fs->exists(path)&&hal.fs->exists(path+".tmp"))hal.fs->rename(path+".tmp",path);
+  return hal.fs->open(path,mode);
+}
+
+static bool archiveHeaderValid(File&f){
+  LogHeader h;
+  f.seek(0,SeekSet);
+  return f.read((uint8_t*)&h,sizeof(h))==sizeof(h)&&h.magic==ARCHIVE_MAGIC&&h.version==ARCHIVE_VERSION&&h.recordSize==sizeof(ArchiveBlock);
+}
+
+static uint16_t archiveBlockCrc(const ArchiveBlock&b,const uint8_t*payload){
+  uint32_t crc=crc32Update(0,(const uint8_t*)&b,offsetof(ArchiveBlock,crc));
+  return crc32Update(crc,payload,b.len)&0xFFFF;
+}
+
+// Reads the block at the file position; false at the end of the archive
+// or at a torn or corrupt block.
+static bool readArchiveBlock(File&f,ArchiveBlock&b,uint8_t*payload){
+  uint8_t commit=0;
+  return f.read((uint8_t*)&b,sizeof(b))==sizeof(b)&&b.len<=ARCHIVE_BLOCK_BYTES
+    &&f.read(payload,b.len)==b.len&&f.read(&commit,1)==1
+    &&commit==LOG_COMMIT&&b.crc==archiveBlockCrc(b,payload);
+}
+
+static bool writeArchiveBlock(File&f,ArchiveBlock&b,const uint8_t*payload){
+  uint8_t commit=LOG_COMMIT;
+  b.crc=archiveBlockCrc(b,payload);
+  return f.write((const uint8_t*)&b,sizeof(b))==sizeof(b)&&f.write(payload,b.len)==b.len&&f.write(&commit,1)==1;
+}
+
+#define VARINT_MAX 5
+#define ARCHIVE_RECORD_MAX (1+2*VARINT_MAX)
+
+static uint8_t*putVarint(uint8_t*p,uint32_t v){
+  while(v>=0x80){
+    *p++=(uint8_t)(v|0x80);
+    v>>=7;
+  }
+  *p++=(uint8_t)v;
+  return p;
+}
+
+// False if the varint runs past end
+static bool getVarint(const uint8_t*&p,const uint8_t*end,uint32_t&v){
+  v=0;
+  for(int shift=0;shift<7*VARINT_MAX&&p<end;shift+=7){
+    uint8_t c=*p++;
+    v|=(uint32_t)(c&0x7F)<<shift;
+    if(!(c&0x80))return true;
+  }
+  return false;
+}
+
+size_t archiveBytes(){
+  File f=openArchive("r");
+  size_t size=f?f.size():0;
+  if(f)f.close();
+  return size;
+}
+
+// Size up to the end of the last intact block, or 0 if f is not an
+// archive. next is one past the global index of the last record in it.
+static size_t scanArchive(File&f,size_t&next){
+  next=0;
+  if(!archiveHeaderValid(f))return 0;
+  size_t end=sizeof(LogHeader);
+  ArchiveBlock b;
+  uint8_t payload[ARCHIVE_BLOCK_BYTES];
+  while(readArchiveBlock(f,b,payload)){
+    end+=sizeof(b)+b.len+1;
+    next=b.first+b.count;
+  }
+  return end;
+}
+
+// Drops whole blocks from the front until the archive is within three
+// quarters of its budget, so trimming is not repeated on every eviction.
+// The rest is copied to a temporary file that replaces the archive.
+static void trimArchive(){
+  File in=openArchive("r");
+  if(!in)return;
+  size_t size=in.size();
+  if(!archiveBudget||size<=archiveBudget){
+    in.close();
+    return;
+  }
+  size_t cut=sizeof(LogHeader);
+  ArchiveBlock b;
+  in.seek(cut,SeekSet);
+  while(size-cut>archiveBudget/4*3&&in.read((uint8_t*)&b,sizeof(b))==sizeof(b)){
+    cut+=sizeof(b)+b.len+1;
+    in.seek(cut,SeekSet);
+  }
+  String path=archivePath();
+  File out=hal.fs->open(path+".tmp","w");
+  LogHeader h;
+  in.seek(0,SeekSet);
+  bool ok=out&&in.read((uint8_t*)&h,sizeof(h))==sizeof(h)&&out.write((const uint8_t*)&h,sizeof(h))==sizeof(h);
+  uint8_t buf[128];
+  size_t n;
+  in.seek(cut,SeekSet);
+  while(ok&&(n=in.read(buf,sizeof(buf)))>0)ok=out.write(buf,n)==n;
+  in.close();
+  if(out)out.close();
+  if(!ok){
+    hal.fs->remove(path+".tmp");
+    return;
+  }
+  hal.fs->remove(path);
+  hal.fs->rename(path+".tmp",path);
+  hal.console->println("Archive trimmed by "+String(cut-sizeof(LogHeader))+" bytes");
+}
+
+// Records already archived (power lost mid-eviction) are skipped by
+// index. A record older than the block's first starts a new block, so
+// minTs is always the first record's timestamp.
+size_t archiveLogRecords(size_t from,size_t to){
+  size_t next=0;
+  File f=openArchive("r+");
+  size_t end=f?scanArchive(f,next):0;
+  if(f&&end&&end<f.size())f.truncate(end); // torn tail
+  if(f)f.close();
+  f=openArchive(end?"a":"w");
+  if(!f)return 0;
+  bool ok=true;
+  if(!end){
+    LogHeader h;
+    h.magic=ARCHIVE_MAGIC;
+    h.version=ARCHIVE_VERSION;
+    h.recordSize=sizeof(ArchiveBlock);
+    h.reserved=0;
+    ok=f.write((const uint8_t*)&h,sizeof(h))==sizeof(h);
+  }
+  size_t added=0;
+  LogReader reader;
+  if(ok&&reader.open()){
+    reader.range(std::max(from,next),to);
+    ArchiveBlock b;
+    uint8_t payload[ARCHIVE_BLOCK_BYTES];
+    b.count=0;
+    uint32_t prevEnd=0;
+    LogRecord r;
+    while(ok&&reader.next(r)){
+      if(b.count&&(b.len+ARCHIVE_RECORD_MAX>ARCHIVE_BLOCK_BYTES||b.count==255||r.timestamp<b.minTs)){
+        ok=writeArchiveBlock(f,b,payload);
+        if(ok)added+=b.count;
+        b.count=0;
+      }
+      if(!b.count){
+        b.len=0;
+        b.first=reader.index-1;
+        b.minTs=b.maxTs=prevEnd=r.timestamp;
+      }
+      int32_t d=(int32_t)(r.timestamp-prevEnd);
+      uint8_t*p=payload+b.len;
+      *p++=r.type;
+      p=putVarint(p,((uint32_t)d<<1)^(uint32_t)(d>>31));
+      p=putVarint(p,r.duration);
+      b.len=p-payload;
+      b.count++;
+      b.maxTs=std::max(b.maxTs,r.timestamp);
+      prevEnd=r.timestamp+r.duration;
+    }
+    if(ok&&b.count&&writeArchiveBlock(f,b,payload))added+=b.count;
+    reader.close();
+  }
+  f.close();
+  trimArchive();
+  return added;
+}
+
+bool ArchiveReader::open(){
+  f=openArchive("r");
+  blocks=skipped=corrupt=0;
+  left=0;
+  index=0;
+  if(f&&archiveHeaderValid(f))return true;
+  close();
+  return false;
+}
+
+void ArchiveReader::range(time_t from,time_t to){
+  this->from=from;
+  this->to=to;
+}
+
+// Moves to the next block overlapping [from,to]. Only the header and
+// commit byte of a skipped block are read.
+bool ArchiveReader::nextBlock(){
+  uint8_t commit;
+  while(f.read((uint8_t*)&block,sizeof(block))==sizeof(block)&&block.len<=ARCHIVE_BLOCK_BYTES){
+    if((time_t)block.maxTs<from||(to&&(time_t)block.minTs>to)){
+      size_t at=f.position()+block.len;
+      if(!f.seek(at,SeekSet)||f.read(&commit,1)!=1||commit!=LOG_COMMIT)return false;
+      skipped++;
+      continue;
+    }
+    if(f.read(buf,block.len)!=block.len||f.read(&commit,1)!=1||commit!=LOG_COMMIT||block.crc!=archiveBlockCrc(block,buf)){
+      corrupt++;
+      return false; // blocks are variable-sized: nothing after this can be found
+    }
+    blocks++;
+    pos=0;
+    left=block.count;
+    index=block.first;
+    prevEnd=block.minTs;
+    return true;
+  }
+  return false;
+}
+
+bool ArchiveReader::next(LogRecord&r){
+  if(!f)return false;
+  for(;;){
+    if(!left&&!nextBlock())return false;
+    const uint8_t*p=buf+pos;
+    const uint8_t*end=buf+block.len;
+    uint32_t zz,dur;
+    if(p<end)r.type=*p++;
+    if(p>=end||!getVarint(p,end,zz)||!getVarint(p,end,dur)){
+      left=0; // a block that passed its CRC should not end early
+      corrupt++;
+      continue;
+    }
+    pos=p-buf;
+    left--;
+    index++;
+    r.timestamp=prevEnd+(int32_t)((zz>>1)^(0-(zz&1)));
+    r.duration=dur;
+    prevEnd=r.timestamp+dur;
+    if((time_t)r.timestamp<from||(to&&(time_t)r.timestamp>to))continue;
+    return true;
+  }
+}
+
+void ArchiveReader::close(){
+  f.close();
+}
+
+// Evicts the oldest segments beyond retentionMonths, or while the log is
+// over retentionBytes, never touching the current and previous month.
+void applyRetention(){
+  uint8_t keep=std::max(retentionMonths,(uint8_t)RETENTION_MIN_MONTHS);
+  while(segments.size()>1){
+    uint32_t age=segments.back().month-segments.front().month;
+    bool tooOld=age>=keep||segments.size()>MANIFEST_MAX;
+    bool tooBig=retentionBytes&&age>=RETENTION_MIN_MONTHS&&logBytes()>retentionBytes;
+    if(!tooOld&&!tooBig)break;
+    Segment s=segments.front();
+    compactSegment(s);
+    archiveLogRecords(s.base,s.base+s.count);
+    segments.erase(segments.begin());
+    saveManifest();
+    hal.fs->remove(segmentPath(s.month));
+    logGeneration++;
+    hal.console->println("Log segment "+segmentPath(s.month)+" compacted into daily summaries and the archive");
+  }
+}
+
+// Removes every segment and the manifest, summaries and archive, not the
+// aggregates.
+void removeLogSegments(){
+  for(const Segment&s:segments)hal.fs->remove(segmentPath(s.month));
+  segments.clear();
+  logGeneration++;
+  hal.fs->remove(logDir+"/manifest.bin");
+  hal.fs->remove(logDir+"/manifest.bin.tmp");
+  hal.fs->remove(logDir+"/daily.bin");
+  hal.fs->remove(archivePath());
+  hal.fs->remove(archivePath()+".tmp");
+}
+
+const char*eventLabel(uint8_t type){
+  switch(EV_KIND(type)){
+    case EV_ON:return "ON";
+    case EV_RESTART:return "RESTART";
+    case EV_SAG:return "SAG";
+    case EV_SWELL:return "SWELL";
+    default:return "OFF";
+  }
+}
+
+const char*resetCauseName(uint8_t cause){
+  switch(cause){
+    case 0:return "Power loss"; // REASON_DEFAULT_RST
+    case 1:return "Hardware watchdog";
+    case 2:return "Exception";
+    case 3:return "Software watchdog";
+    case 4:return "Software restart";
+    case 5:return "Deep sleep wake";
+    case 6:return "External reset";
+    default:return "Unknown";
+  }
+}
+
+uint32_t crc32Update(uint32_t crc,const uint8_t*data,size_t len){
+  crc=~crc;
+  while(len--){
+    crc^=*data++;
+    for(int i=0;i<8;i++)crc=(crc>>1)^(0xEDB88320&(0-(crc&1)));
+  }
+  return ~crc;
+}
+
+// Local calendar day as days since 1970-01-01.
+int32_t dayNumber(time_t t){
+  return calendarDay(t).day;
+}
+
+uint32_t logStateKey(uint32_t salt,time_t now){
+  uint32_t stamp[3]={salt,logGeneration,(uint32_t)(now/3600)};
+  int32_t day=dayNumber(now);
+  uint32_t crc=crc32Update(0,(const uint8_t*)stamp,sizeof(stamp));
+  return crc32Update(crc,(const uint8_t*)&day,sizeof(day));
+}
+
+uint32_t monthNumber(time_t t){
+  return calendarDay(t).month;
+}
+
+bool isDayStart(time_t t){
+  return calendarDay(t).start==t;
+}
+
+int hourOfDay(time_t t){
+  const CalendarDay&c=calendarDay(t);
+  if(c.end-c.start==86400)return (t-c.start)/3600;
+  return localtime(&t)->tm_hour;
+}
+
+void resetAggregates(){
+  for(int i=0;i<AGG_DAYS;i++){
+    dayBuckets[i].day=-1;
+    dayBuckets[i].off=dayBuckets[i].on=0;
+    dayBuckets[i].first=dayBuckets[i].last=0;
+  }
+  aggRecordCount=0;
+}
+
+void addToAggregates(const LogRecord&r,uint32_t index){
+  aggRecordCount=index+1;
+  int32_t day=dayNumber(r.timestamp);
+  DayBucket&b=dayBuckets[((day%AGG_DAYS)+AGG_DAYS)%AGG_DAYS];
+  if(b.day>day)return; // older than anything a stats window can reach
+  if(b.day!=day){
+    b.day=day;
+    b.off=b.on=0;
+    b.first=index;
+  }
+  b.last=index;
+  if(EV_KIND(r.type)==EV_OFF)b.off+=r.duration;
+  else if(EV_KIND(r.type)==EV_ON)b.on+=r.duration;
+}
+
+uint32_t aggregatesCrc(){
+  uint32_t crc=crc32Update(0,(const uint8_t*)&aggRecordCount,sizeof(aggRecordCount));
+  return crc32Update(crc,(const uint8_t*)dayBuckets,sizeof(dayBuckets));
+}
+
+void saveAggregates(){
+  File f=hal.fs->open(aggFile,"w");
+  if(!f)return;
+  AggHeader h;
+  h.magic=AGG_MAGIC;
+  h.version=AGG_VERSION;
+  h.days=AGG_DAYS;
+  h.reserved=0;
+  h.recordCount=aggRecordCount;
+  h.crc=aggregatesCrc();
+  f.write((const uint8_t*)&h,sizeof(h));
+  f.write((const uint8_t*)dayBuckets,sizeof(dayBuckets));
+  f.close();
+}
+
+// Only records young enough to land in a bucket are read, so a rebuild
+// touches the last one or two segments however long the log is.
+void rebuildAggregates(){
+  resetAggregates();
+  LogReader reader;
+  LogRecord r;
+  if(reader.open()){
+    time_t now=hal.clock->now();
+    if(now>=100000)reader.range(findLogRecord(now-AGG_DAYS*86400L),reader.total);
+    while(reader.next(r))addToAggregates(r,reader.index-1);
+    aggRecordCount=reader.total;
+    reader.close();
+  }
+  saveAggregates();
+}
+
+// Load the persisted day buckets, falling back to a full rebuild when the
+// cache is missing, corrupt or out of step with the log.
+void loadAggregates(){
+  size_t count=logTotal();
+  File f=hal.fs->open(aggFile,"r");
+  bool ok=false;
+  if(f){
+    AggHeader h;
+    ok=f.read((uint8_t*)&h,sizeof(h))==sizeof(h)&&h.magic==AGG_MAGIC&&h.version==AGG_VERSION&&h.days==AGG_DAYS
+      &&f.read((uint8_t*)dayBuckets,sizeof(dayBuckets))==sizeof(dayBuckets);
+    if(ok){
+      aggRecordCount=h.recordCount;
+      ok=h.crc==aggregatesCrc()&&aggRecordCount==count;
+    }
+    f.close();
+  }
+  if(!ok){
+    hal.console->println("Rebuilding stats cache from log");
+    rebuildAggregates();
+  }
+}
+
+LogEventHook logEventHook=nullptr;
+
+void logEvent(uint8_t type,time_t t,time_t dur){
+  LogRecord r;
+  r.type=type;
+  r.timestamp=(uint32_t)t;
+  r.duration=(uint32_t)dur;
+  if(appendLogRecords(&r,1)!=1)return;
+  uint32_t index=logTotal()-1;
+  if(index!=aggRecordCount)rebuildAggregates();
+  else{
+    addToAggregates(r,index);
+    saveAggregates();
+  }
+  if(logEventHook)logEventHook(index,r);
+}
+
+// Random access to record N: one manifest lookup and one seek.
+bool readLogEntry(size_t index,LogEntry&e){
+  LogReader reader;
+  LogRecord r;
+  if(!reader.open())return false;
+  reader.range(index,index+1);
+  bool ok=reader.index==index&&reader.next(r);
+  reader.close();
+  if(ok)toLogEntry(r,e);
+  return ok;
+}
+
+// One-time conversion of the old "[TYPE] ts dur" text log to a version 1
+// single-file log, which migrateFlatLog() then splits into segments.
+void migrateTextLog(){
+  if(!hal.fs->exists(legacyLogFile))return;
+  File in=hal.fs->open(legacyLogFile,"r");
+  if(!in)return;
+  String tmpFile=legacyFlatLogFile+".tmp";
+  File out=hal.fs->open(tmpFile,"w");
+  if(!out){
+    in.close();
+    return;
+  }
+  writeLogHeader(out,1);
+  size_t migrated=0;
+  char line[48];
+  while(in.available()){
+    size_t n=in.readBytesUntil('\n',line,sizeof(line)-1);
+    line[n]=0;
+    char*sp1=strchr(line,' ');
+    if(!sp1)continue;
+    *sp1=0;
+    char*end=nullptr;
+    LogRecord r;
+    r.type=(strcmp(line,"[ON]")==0)?EV_ON:EV_OFF;
+    r.timestamp=strtoul(sp1+1,&end,10);
+    r.duration=(end&&*end==' ')?strtoul(end+1,nullptr,10):0;
+    if(r.timestamp==0)continue;
+    out.write((const uint8_t*)&r,sizeof(r));
+    migrated++;
+  }
+  in.close();
+  out.close();
+  hal.fs->remove(legacyFlatLogFile);
+  if(hal.fs->rename(tmpFile,legacyFlatLogFile)){
+    hal.fs->remove(legacyLogFile);
+    hal.console->println("Migrated "+String(migrated)+" log entries to binary format");
+  }
+}
+
+// One-time split of the single-file binary log into monthly segments.
+// Records keep their indexes, so the aggregates stay valid.
+void migrateFlatLog(){
+  if(!segments.empty()||!hal.fs->exists(legacyFlatLogFile))return;
+  File f=hal.fs->open(legacyFlatLogFile,"r");
+  if(!f)return;
+  size_t migrated=0;
+  bool ok=true;
+  if(logFileVersion(f)==1){
+    LogRecord batch[16];
+    size_t n;
+    while(ok&&(n=f.read((uint8_t*)batch,sizeof(batch))/sizeof(LogRecord))>0){
+      ok=appendLogRecords(batch,n)==n;
+      migrated+=n;
+    }
+  }
+  f.close();
+  if(!ok)return; // retried on the next boot
+  hal.fs->remove(legacyFlatLogFile);
+  hal.console->println("Split "+String(migrated)+" log entries into "+String(segments.size())+" monthly segments");
+}
+
+// The last-on heartbeat rotates through HEARTBEAT_SLOTS fixed slots in
+// one file so no single location takes every write. The valid slot with
+// the highest sequence number wins; a torn write only loses that beat.
+struct __attribute__((packed)) HeartbeatSlot{
+  uint32_t seq;
+  uint32_t timestamp;
+  uint32_t crc;
+};
+
+uint32_t heartbeatSeq=0;
+uint8_t heartbeatSlot=HEARTBEAT_SLOTS-1;
+
+uint32_t heartbeatCrc(const HeartbeatSlot&h){
+  return crc32Update(0,(const uint8_t*)&h,offsetof(HeartbeatSlot,crc));
+}
+
+time_t readHeartbeat(){
+  heartbeatSeq=0;
+  heartbeatSlot=HEARTBEAT_SLOTS-1;
+  File f=hal.fs->open(heartbeatFile,"r");
+  if(!f)return 0;
+  time_t last=0;
+  HeartbeatSlot h;
+  for(uint8_t i=0;i<HEARTBEAT_SLOTS;i++){
+    if(f.read((uint8_t*)&h,sizeof(h))!=sizeof(h))break;
+    if(h.crc!=heartbeatCrc(h)||h.seq<=heartbeatSeq)continue;
+    heartbeatSeq=h.seq;
+    heartbeatSlot=i;
+    last=h.timestamp;
+  }
+  f.close();
+  return last;
+}
+
+void writeHeartbeat(time_t t){
+  File f=hal.fs->open(heartbeatFile,"r+");
+  if(f&&f.size()!=HEARTBEAT_SLOTS*sizeof(HeartbeatSlot)){
+    f.close();
+    f=File();
+  }
+  if(!f){
+    // (Re)create with empty slots; zeroed slots fail the CRC check
+    f=hal.fs->open(heartbeatFile,"w");
+    if(!f)return;
+    HeartbeatSlot empty;
+    memset(&empty,0,sizeof(empty));
+    for(uint8_t i=0;i<HEARTBEAT_SLOTS;i++)f.write((const uint8_t*)&empty,sizeof(empty));
+  }
+  HeartbeatSlot h;
+  h.seq=++heartbeatSeq;
+  h.timestamp=(uint32_t)t;
+  h.crc=heartbeatCrc(h);
+  heartbeatSlot=(heartbeatSlot+1)%HEARTBEAT_SLOTS;
+  f.seek(heartbeatSlot*sizeof(HeartbeatSlot),SeekSet);
+  f.write((const uint8_t*)&h,sizeof(h));
+  f.close();
+}
+
+void clearHeartbeat(){
+  hal.fs->remove(heartbeatFile);
+  heartbeatSeq=0;
+  heartbeatSlot=HEARTBEAT_SLOTS-1;
+}
+
+// Removes the log, its aggregates and the heartbeat.
+void clearLog(){
+  removeLogSegments();
+  clearHeartbeat();
+  hal.fs->remove(aggFile);
+  resetAggregates();
+  resetOutageStats();
+}
+
+std::vector<LogEntry>parseLog(){
+  std::vector<LogEntry>entries;
+  LogReader reader;
+  if(!reader.open())return entries;
+  entries.reserve(reader.count);
+  LogRecord r;
+  while(reader.next(r)){
+    LogEntry e;
+    toLogEntry(r,e);
+    entries.push_back(e);
+  }
+  reader.close();
+  return entries;
+}
+
+// Sum the day buckets on or after cutoff. Only the bucket holding the
+// cutoff itself is re-read from the log, and only when cutoff is mid-day.
+void sumWindow(time_t cutoff,time_t&off,time_t&on){
+  int32_t cutDay=dayNumber(cutoff);
+  bool midDay=!isDayStart(cutoff);
+  for(int i=0;i<AGG_DAYS;i++){
+    const DayBucket&b=dayBuckets[i];
+    if(b.day<0||b.day<cutDay||(midDay&&b.day==cutDay))continue;
+    off+=b.off;
+    on+=b.on;
+  }
+  if(!midDay)return;
+  const DayBucket&b=dayBuckets[((cutDay%AGG_DAYS)+AGG_DAYS)%AGG_DAYS];
+  if(b.day!=cutDay)return;
+  LogReader reader;
+  LogRecord r;
+  if(!reader.open())return;
+  reader.range(b.first,b.last+1);
+  while(reader.next(r)){
+    if((time_t)r.timestamp<cutoff||dayNumber(r.timestamp)!=cutDay)continue;
+    if(EV_KIND(r.type)==EV_OFF)off+=r.duration;
+    else if(EV_KIND(r.type)==EV_ON)on+=r.duration;
+  }
+  reader.close();
+}
+
+Stats calculateStats(){
+  Stats s;
+  time_t now=hal.clock->now();
+  if(now<statsDayStart||now>=statsDayEnd){
+    const CalendarDay&c=calendarDay(now);
+    statsDayStart=c.start;
+    statsDayEnd=c.end;
+    struct tm tm=*localtime(&now);
+    tm.tm_mday=1;
+    tm.tm_hour=tm.tm_min=tm.tm_sec=0;
+    tm.tm_isdst=-1;
+    statsMonthStart=mktime(&tm);
+  }
+  
+  sumWindow(statsDayStart,s.todayOff,s.todayOn);
+  sumWindow(now-7*86400,s.last7Off,s.last7On);
+  sumWindow(now-15*86400,s.last15Off,s.last15On);
+  sumWindow(statsMonthStart,s.monthOff,s.monthOn);
+  return s;
+}
+
+void OutageStats::reset(){
+  memset(this,0,sizeof(*this));
+  minOff=UINT32_MAX;
+}
+
+static size_t outageBin(uint32_t d){
+  if(d<4)return d;
+  int o=31-__builtin_clz(d);
+  return (o-1)*4+((d>>(o-2))&3);
+}
+
+uint32_t outageBinStart(size_t bin){
+  if(bin<4)return bin;
+  int o=bin/4+1;
+  return (uint32_t)(4+bin%4)<<(o-2);
+}
+
+void OutageStats::add(const LogRecord&r){
+  if(EV_KIND(r.type)==EV_RESTART){
+    restarts++;
+    return;
+  }
+  if(EV_KIND(r.type)!=EV_OFF)return;
+  uint32_t d=r.duration;
+  time_t start=r.timestamp;
+  outages++;
+  totalOff+=d;
+  minOff=std::min(minOff,d);
+  if(d>maxOff||outages==1){
+    maxOff=d;
+    longestAt=start;
+  }
+  if(!firstAt)firstAt=start;
+  lastAt=start;
+  if(prevEnd&&start>prevEnd){
+    totalUp+=start-prevEnd;
+    upGaps++;
+  }
+  prevEnd=start+d;
+  bins[outageBin(d)]++;
+  uint16_t&cell=heatmap[(dayNumber(start)%7+11)%7][hourOfDay(start)]; // day 0 was a Thursday
+  if(cell<UINT16_MAX)cell++;
+}
+
+uint32_t OutageStats::meanOff()const{
+  return outages?totalOff/outages:0;
+}
+
+// Midpoint of the bin holding the p-th percentile, clamped to the
+// observed range
+uint32_t OutageStats::percentile(uint8_t p)const{
+  if(!outages)return 0;
+  uint32_t rank=std::max<uint32_t>(1,((uint64_t)outages*p+99)/100);
+  uint32_t seen=0;
+  for(size_t i=0;i<OUTAGE_BINS;i++){
+    seen+=bins[i];
+    if(seen<rank)continue;
+    uint32_t lo=outageBinStart(i);
+    uint32_t hi=(i+1<OUTAGE_BINS)?outageBinStart(i+1)-1:UINT32_MAX;
+    uint32_t mid=lo+(hi-lo)/2;
+    return std::max(minOff,std::min(maxOff,mid));
+  }
+  return maxOff;
+}
+
+uint32_t OutageStats::mtbf()const{
+  return upGaps?totalUp/upGaps:0;
+}
+
+static OutageStats outageStats;
+static size_t outageFirst=0; // logFirst() when the stats were started
+static size_t outageNext=SIZE_MAX; // next record to fold in
+
+void resetOutageStats(){
+  outageNext=SIZE_MAX;
+}
+
+const OutageStats&calculateOutageStats(){
+  size_t first=logFirst(),total=logTotal();
+  if(outageNext==SIZE_MAX||outageFirst!=first||outageNext>total){
+    outageStats.reset();
+    outageFirst=first;
+    outageNext=first;
+  }
+  if(outageNext==total)return outageStats;
+  LogReader reader;
+  LogRecord r;
+  if(!reader.open())return outageStats;
+  reader.range(outageNext,total);
+  while(reader.next(r))outageStats.add(r);
+  outageNext=reader.index;
+  reader.close();
+  return outageStats;
+}
+
+static void writeEntryJson(Print&out,size_t index,const LogRecord&r){
+  out.print("{\"index\":");
+  out.print(index);
+  out.print(",\"type\":\"");
+  out.print(eventLabel(r.type));
+  if(EV_HAS_CAUSE(r.type)){
+    out.print("\",\"cause\":\"");
+    out.print(resetCauseName(EV_CAUSE(r.type)));
+  }
+  out.print("\",\"timestamp\":");
+  out.print(r.timestamp);
+  out.print(",\"duration\":");
+  out.print(r.duration);
+  out.print("}");
+}
+
+// JSON page of log records: {"total":..,"matched":..,"offset":..,"entries":[..]}
+void writeLogJson(Print&out,LogReader&reader,const LogQuery&q){
+  bool ok=(bool)reader.f;
+  LogRecord r;
+  out.print("{\"total\":");
+  out.print(ok?reader.total-reader.first:0);
+  out.print(",\"matched\":");
+  out.print(q.matched);
+  out.print(",\"offset\":");
+  out.print(q.offset);
+  out.print(",\"entries\":[");
+  if(ok){
+    // Not reader.index: next() skips frames that fail their CRC
+    bool first=true;
+    while(reader.next(r)){
+      if(!first)out.print(",");
+      first=false;
+      writeEntryJson(out,reader.index-1,r);
+    }
+    reader.close();
+  }
+  out.print("]}");
+}
+
+void writeLogCsv(Print&out,LogReader&reader){
+  LogRecord r;
+  out.print("index,type,timestamp,duration,cause\r\n");
+  if(!reader.f)return;
+  while(reader.next(r)){
+    out.print(reader.index-1);
+    out.print(",");
+    out.print(eventLabel(r.type));
+    out.print(",");
+    out.print(r.timestamp);
+    out.print(",");
+    out.print(r.duration);
+    out.print(",");
+    if(EV_HAS_CAUSE(r.type))out.print(resetCauseName(EV_CAUSE(r.type)));
+    out.print("\r\n");
+  }
+  reader.close();
+}
+
+void resolveLogQuery(LogReader&reader,LogQuery&q,long offset){
+  size_t start=(q.from>0)?findLogRecord(q.from):reader.first;
+  size_t end=(q.to>0)?findLogRecord(q.to+1):reader.total;
+  if(end<start)end=start;
+  q.matched=end-start;
+  if(offset<0)q.offset=(q.matched>q.limit)?q.matched-q.limit:0;
+  else q.offset=std::min((size_t)offset,q.matched);
+  q.first=start+q.offset;
+  q.last=q.first+std::min(q.limit,end-q.first);
+  reader.range(q.first,q.last);
+}
+
+// Exported as version 1 (bare records): frames are an on-flash detail,
+// and corrupt frames are left out.
+void writeLogRaw(Print&out){
+  writeLogHeaderTo(out,1);
+  LogReader reader;
+  LogRecord r;
+  if(!reader.open())return;
+  while(reader.next(r))out.write((const uint8_t*)&r,sizeof(r));
+  reader.close();
+}
+
+void writeOutageJson(Print&out){
+  const OutageStats&o=calculateOutageStats();
+  out.print("{\"count\":");
+  out.print(o.outages);
+  out.print(",\"restarts\":");
+  out.print(o.restarts);
+  out.print(",\"totalOff\":");
+  out.print((unsigned long)o.totalOff);
+  out.print(",\"meanOff\":");
+  out.print(o.meanOff());
+  out.print(",\"medianOff\":");
+  out.print(o.percentile(50));
+  out.print(",\"p95Off\":");
+  out.print(o.percentile(95));
+  out.print(",\"maxOff\":");
+  out.print(o.maxOff);
+  out.print(",\"longestAt\":");
+  out.print((unsigned long)o.longestAt);
+  out.print(",\"mtbf\":");
+  out.print(o.mtbf());
+  out.print(",\"firstAt\":");
+  out.print((unsigned long)o.firstAt);
+  out.print(",\"lastAt\":");
+  out.print((unsigned long)o.lastAt);
+  out.print(",\"histogram\":[");
+  bool first=true;
+  for(size_t i=0;i<OUTAGE_BINS;i++){
+    if(!o.bins[i])continue;
+    if(!first)out.print(",");
+    first=false;
+    out.print("{\"from\":");
+    out.print(outageBinStart(i));
+    out.print(",\"count\":");
+    out.print(o.bins[i]);
+    out.print("}");
+  }
+  out.print("],\"heatmap\":[");
+  for(int d=0;d<OUTAGE_DAYS;d++){
+    out.print(d?",[":"[");
+    for(int h=0;h<OUTAGE_HOURS;h++){
+      if(h)out.print(",");
+      out.print(o.heatmap[d][h]);
+    }
+    out.print("]");
+  }
+  out.print("]}");
+}
+
+void writeArchiveJson(Print&out,time_t from,time_t to){
+  ArchiveReader reader;
+  LogRecord r;
+  bool first=true;
+  out.print("{\"entries\":[");
+  if(reader.open()){
+    reader.range(from,to);
+    while(reader.next(r)){
+      if(!first)out.print(",");
+      first=false;
+      writeEntryJson(out,reader.index-1,r);
+    }
+    reader.close();
+  }
+  out.print("],\"blocks\":");
+  out.print(reader.blocks);
+  out.print(",\"skipped\":");
+  out.print(reader.skipped);
+  out.print("}");
+}
+
+void writeDailyJson(Print&out){
+  out.print("{\"days\":[");
+  File f=hal.fs->open(logDir+"/daily.bin","r");
+  LogHeader h;
+  if(f&&f.read((uint8_t*)&h,sizeof(h))==sizeof(h)&&h.magic==DAILY_MAGIC&&h.version==DAILY_VERSION&&h.recordSize==sizeof(DaySummary)){
+    DaySummary d;
+    bool first=true;
+    while(f.read((uint8_t*)&d,sizeof(d))==sizeof(d)){
+      // Noon of that day: the date is right whatever the zone offset
+      time_t noon=(time_t)d.day*86400+12*3600;
+      char date[12];
+      strftime(date,sizeof(date),"%Y-%m-%d",gmtime(&noon));
+      if(!first)out.print(",");
+      first=false;
+      out.print("{\"day\":\"");
+      out.print(date);
+      out.print("\",\"off\":");
+      out.print(d.off);
+      out.print(",\"on\":");
+      out.print(d.on);
+      out.print(",\"outages\":");
+      out.print(d.outages);
+      out.print(",\"restarts\":");
+      out.print(d.restarts);
+      out.print("}");
+    }
+  }
+  if(f)f.close();
+  out.print("]}");
+}
@@ -0,0 +1,352 @@
+#pragma once
+#include <Arduino.h>
+#include <FS.h>
+#include <time.h>
+#include <vector>
+#include "hal.h"
+
+// Power event log, per-day aggregates and statistics. Everything here
+// goes through hal, so it builds for the device and natively.
+
+// EEPROM, see the layout in main.cpp. 256-259 held the last monthly
+// reset, which segmented retention replaced.
+#define RETENTION_ADDR 260 // months (1 byte), budget in KB (2 bytes)
+
+#define LOG_MAGIC 0x474C5045 // "EPLG"
+#define LOG_VERSION 2 // 1: bare 9-byte records (exports, older firmware)
+#define LOG_COMMIT 0xA5 // last byte of every complete frame
+#define LOG_RECOVERY_FRAMES 8 // tail frames checked at boot
+// Type byte: event kind in the low nibble, reset cause (rst_info reason)
+// in the high nibble. Cause 0 is a power-on reset. SAG and SWELL are
+// supply excursions that did not reset the chip (see supply.h).
+#define EV_ON 1
+#define EV_OFF 2
+#define EV_RESTART 3
+#define EV_SAG 4
+#define EV_SWELL 5
+#define EV_KIND(t) ((t)&0x0F)
+#define EV_CAUSE(t) ((t)>>4)
+#define EV_HAS_CAUSE(t) (EV_KIND(t)==EV_OFF||EV_KIND(t)==EV_RESTART)
+
+#define AGG_MAGIC 0x47475041 // "APGG"
+#define AGG_VERSION 1
+#define AGG_DAYS 32
+
+#define HEARTBEAT_SLOTS 16
+#define HEARTBEAT_INTERVAL 60000
+
+// The log is split into one segment file per local calendar month,
+// listed in a manifest. Segments older than the retention budget are
+// folded into daily summaries and removed.
+#define MANIFEST_MAGIC 0x464E4D45 // "EMNF"
+#define MANIFEST_VERSION 1
+#define MANIFEST_MAX 64
+#define DAILY_MAGIC 0x594C4944 // "DILY"
+#define DAILY_VERSION 1
+#define RETENTION_MONTHS 6 // default, configurable on /config
+#define RETENTION_MIN_MONTHS 2 // current and previous month: the stats windows reach 31 days back
+
+// Evicted segments are also kept record for record in a compressed
+// archive of small blocks, each tagged with its time range so a query
+// can skip it undecoded. The oldest blocks go once it is over budget.
+#define ARCHIVE_MAGIC 0x56435241 // "ARCV"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_BLOCK_BYTES 240 // payload per block
+#define ARCHIVE_MAX_BYTES 65536 // default budget
+
+struct LogEntry{
+  uint8_t type;
+  time_t timestamp;
+  time_t duration;
+};
+
+// On-flash layout: one LogHeader followed by fixed-size LogFrames, so
+// record N lives at sizeof(LogHeader)+N*sizeof(LogFrame).
+struct __attribute__((packed)) LogHeader{
+  uint32_t magic;
+  uint8_t version;
+  uint8_t recordSize;
+  uint16_t reserved;
+};
+
+struct __attribute__((packed)) LogRecord{
+  uint8_t type;
+  uint32_t timestamp;
+  uint32_t duration;
+};
+
+// Journal framing of one record. crc is the low half of the CRC32 over
+// len and rec; commit is written last, so a frame cut short by power
+// loss fails either the CRC or the commit check.
+struct __attribute__((packed)) LogFrame{
+  uint8_t len; // sizeof(LogRecord)
+  LogRecord rec;
+  uint16_t crc;
+  uint8_t commit;
+};
+
+// Per-day ON/OFF totals, slot = day%AGG_DAYS. first/last bound the log
+// records that fall on this day so a partial day can be re-read exactly.
+struct __attribute__((packed)) DayBucket{
+  int32_t day;
+  uint32_t off;
+  uint32_t on;
+  uint32_t first;
+  uint32_t last;
+};
+
+// RAM view of a manifest entry. Record indexes are global and keep
+// counting across segments, so evicting old segments does not renumber
+// the rest; base is the index of the segment's first record.
+struct Segment{
+  uint32_t month; // local (year-1900)*12+month0
+  uint32_t base;
+  uint32_t count; // from the file size
+  uint32_t firstTs;
+};
+
+// Compacted record for one local day of an evicted segment.
+struct __attribute__((packed)) DaySummary{
+  int32_t day;
+  uint32_t off;
+  uint32_t on;
+  uint16_t outages;
+  uint16_t restarts;
+};
+
+// One archive block: this header, len bytes of records, then LOG_COMMIT.
+// A record is its type byte, the zigzag varint of its timestamp minus
+// the previous record's timestamp+duration (minTs for the first, so an
+// ON right after its OFF costs one byte) and the varint duration. crc is
+// the low half of the CRC32 over the header up to crc and the records.
+struct __attribute__((packed)) ArchiveBlock{
+  uint8_t len;
+  uint8_t count;
+  uint32_t first; // global index of the first record
+  uint32_t minTs;
+  uint32_t maxTs;
+  uint16_t crc;
+};
+
+struct Stats{
+  time_t todayOff;
+  time_t todayOn;
+  time_t last7Off;
+  time_t last7On;
+  time_t last15Off;
+  time_t last15On;
+  time_t monthOff;
+  time_t monthOn;
+  Stats():todayOff(0),todayOn(0),last7Off(0),last7On(0),last15Off(0),last15On(0),monthOff(0),monthOn(0){}
+};
+
+// Outage analytics over the retained log, folded in one record at a
+// time into fixed-size histograms, so memory does not grow with the log.
+// Durations are binned log-scaled: 4 bins per power of two, exact below
+// 4 s, so percentiles are within about 12%.
+#define OUTAGE_BINS 124
+#define OUTAGE_DAYS 7 // heatmap rows, Sunday first
+#define OUTAGE_HOURS 24
+
+struct OutageStats{
+  uint32_t outages;
+  uint32_t restarts;
+  uint64_t totalOff;
+  uint32_t minOff;
+  uint32_t maxOff;
+  time_t longestAt; // start of the longest outage
+  time_t firstAt;
+  time_t lastAt;
+  uint64_t totalUp; // between the end of one outage and the start of the next
+  uint32_t upGaps;
+  time_t prevEnd;
+  uint32_t bins[OUTAGE_BINS];
+  uint16_t heatmap[OUTAGE_DAYS][OUTAGE_HOURS]; // outage starts, local time
+  
+  void reset();
+  void add(const LogRecord&r);
+  uint32_t meanOff()const;
+  uint32_t percentile(uint8_t p)const; // 0 if there are no outages
+  uint32_t mtbf()const; // mean uptime between outages, 0 if under two
+};
+
+uint32_t outageBinStart(size_t bin); // shortest duration that lands in bin
+
+// Sequential reader over the log records of all segments, buffered in
+// small batches. Records are numbered globally from first to total-1;
+// index is one past the record last returned by next().
+struct LogReader{
+  File f;
+  size_t seg=0; // segment f belongs to
+  size_t first=0;
+  size_t total=0;
+  size_t count=0;
+  size_t index=0;
+  size_t corrupt=0; // frames skipped for a bad CRC or commit byte
+  LogFrame buf[16];
+  size_t bufLen=0;
+  size_t bufPos=0;
+  
+  bool open();
+  void range(size_t from,size_t to); // restrict reading to [from,to)
+  bool next(LogRecord&r);
+  void close();
+private:
+  bool openSegment(size_t i,size_t at);
+};
+
+// Sequential reader over the archive. Blocks entirely outside
+// [from,to] are skipped by their header; records in the blocks that are
+// decoded are filtered one by one. index is one past the global index
+// of the record last returned, as in LogReader.
+struct ArchiveReader{
+  File f;
+  time_t from=0;
+  time_t to=0; // 0 = unbounded
+  size_t index=0;
+  size_t blocks=0; // decoded
+  size_t skipped=0; // passed over by their time range
+  size_t corrupt=0; // blocks dropped for a bad CRC or commit byte
+  ArchiveBlock block;
+  uint8_t buf[ARCHIVE_BLOCK_BYTES];
+  size_t pos=0;
+  size_t left=0; // records not yet decoded in block
+  uint32_t prevEnd=0;
+  
+  bool open();
+  void range(time_t from,time_t to);
+  bool next(LogRecord&r);
+  void close();
+private:
+  bool nextBlock();
+};
+
+// A page of log records selected by from/to (inclusive Unix timestamps,
+// 0 = unbounded) and offset/limit. offset counts records from the start
+// of the time range.
+struct LogQuery{
+  time_t from=0;
+  time_t to=0;
+  size_t offset=0;
+  size_t limit=0;
+  size_t matched=0;
+  size_t first=0;
+  size_t last=0;
+};
+
+extern String logDir;
+extern String legacyFlatLogFile;
+extern String legacyLogFile;
+extern String heartbeatFile;
+extern String legacyLastOnFile;
+extern String aggFile;
+extern DayBucket dayBuckets[AGG_DAYS];
+extern uint32_t aggRecordCount;
+extern std::vector<Segment>segments;
+extern uint8_t retentionMonths;
+extern uint32_t retentionBytes;
+extern uint32_t archiveBudget; // bytes, 0 = unbounded
+
+void saveString(int addr,const String&s,int maxLen);
+String readString(int addr,int maxLen);
+void loadRetention();
+void saveRetention(); // like saveString, the caller commits
+
+// Timestamps and durations as text. The buffer versions and the print
+// helpers do not touch the heap; the String versions are for one-offs.
+#define TIME_TEXT_LEN 20 // "YYYY-MM-DD HH:MM:SS"
+#define DURATION_TEXT_LEN 24 // "49710d 23h 59m 59s"
+const char*formatTime(time_t t,char*buf);
+const char*formatDuration(time_t s,char*buf);
+void printTime(Print&out,time_t t);
+void printDuration(Print&out,time_t s);
+String getTimeString(time_t t);
+String formatDuration(time_t s);
+const char*eventLabel(uint8_t type);
+const char*resetCauseName(uint8_t cause);
+uint32_t crc32Update(uint32_t crc,const uint8_t*data,size_t len);
+// Calendar lookups share a one-day cache; calendarLookups counts the
+// misses (localtime() calls). Reset the cache after changing the TZ.
+extern uint32_t calendarLookups;
+void resetCalendarCache();
+int32_t dayNumber(time_t t);
+uint32_t monthNumber(time_t t); // local (year-1900)*12+month0
+bool isDayStart(time_t t); // local midnight
+int hourOfDay(time_t t); // local
+
+uint8_t logFileVersion(File&f); // 0 if the header is not a log header
+bool readLogHeader(File&f); // current version only
+bool writeLogHeader(File&f,uint8_t version=LOG_VERSION);
+size_t logRecordCount(File&f);
+void makeLogFrame(const LogRecord&r,LogFrame&fr);
+bool logFrameValid(const LogFrame&fr);
+void toLogEntry(const LogRecord&r,LogEntry&e);
+
+String segmentPath(uint32_t month);
+String archivePath();
+void loadSegments();
+size_t logFirst();
+size_t logTotal();
+size_t logBytes();
+size_t findLogRecord(time_t t);
+// Appends records in time order, opening new monthly segments as needed.
+// Does not touch the aggregates. Returns the number written.
+size_t appendLogRecords(const LogRecord*recs,size_t n);
+void applyRetention();
+size_t archiveBytes();
+// Appends the records of [from,to) not archived yet, then trims the
+// archive to its budget. Returns the number added.
+size_t archiveLogRecords(size_t from,size_t to);
+void removeLogSegments();
+
+// Bumped whenever the retained log changes: a record logged, the log
+// cleared or a segment evicted. Responses cached on it (cache.h) are
+// current as long as it has not moved.
+extern uint32_t logGeneration;
+// CRC32 of salt, logGeneration and the hour and local day of now: the
+// part of a response cache key that moves whenever a response derived
+// from the log could differ for the same request. The rolling 7/15-day
+// windows move on even without new records, hence the hour.
+uint32_t logStateKey(uint32_t salt,time_t now);
+
+// Called by logEvent() after each record is stored (live updates)
+typedef void(*LogEventHook)(size_t index,const LogRecord&r);
+extern LogEventHook logEventHook;
+
+void logEvent(uint8_t type,time_t t,time_t dur=0);
+bool readLogEntry(size_t index,LogEntry&e);
+void migrateTextLog();
+void migrateFlatLog();
+std::vector<LogEntry>parseLog();
+void clearLog();
+
+void resetAggregates();
+void rebuildAggregates();
+void loadAggregates();
+Stats calculateStats();
+// Folds in the records logged since the last call; a cleared or evicted
+// log starts over. The result is shared, so copy it to keep it.
+const OutageStats&calculateOutageStats();
+void resetOutageStats();
+
+time_t readHeartbeat();
+void writeHeartbeat(time_t t);
+void clearHeartbeat();
+
+// Positions reader on the page described by q.from/q.to/q.limit and
+// offset (negative selects the newest page) and fills in the rest of q.
+void resolveLogQuery(LogReader&reader,LogQuery&q,long offset);
+
+// Export the records left in an opened (and optionally ranged) reader.
+// A reader whose open() failed yields an empty export. Both close reader.
+void writeLogJson(Print&out,LogReader&reader,const LogQuery&q);
+void writeLogCsv(Print&out,LogReader&reader);
+// The whole retained log as one file in the single-file layout
+void writeLogRaw(Print&out);
+// calculateOutageStats() as {"count":..,"mtbf":..,"histogram":[..],"heatmap":[[..],..]}
+void writeOutageJson(Print&out);
+// Archived records with from<=timestamp<=to (0 = unbounded), with the
+// entry fields of writeLogJson: {"entries":[..],"blocks":..,"skipped":..}
+void writeArchiveJson(Print&out,time_t from,time_t to);
+// Daily summaries of evicted segments: {"days":[{"day":"YYYY-MM-DD",..},..]}
+void writeDailyJson(Print&out);
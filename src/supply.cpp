@@ -0,0 +1,165 @@
+#include <algorithm>
+#include "supply.h"
+
+#define SUPPLY_PERIOD_MS (1000/SUPPLY_RATE_HZ)
+
+// head and tail count samples since boot and only wrap as uint32_t, so
+// head-tail is the fill level. Each index has exactly one writer.
+static volatile uint16_t ring[SUPPLY_RING];
+static volatile uint32_t ringMs[SUPPLY_RING]; // millis() of each sample
+static volatile uint32_t ringHead=0;
+static volatile uint32_t ringTail=0;
+static volatile uint32_t ringOverruns=0;
+
+static SupplyStatus status;
+static uint32_t excursionStartMs=0,excursionLastMs=0;
+static time_t excursionStart=0;
+static uint32_t lastMs=0; // of the previous sample, if haveLast
+static bool haveLast=false;
+
+// Second being accumulated, then the ring of complete ones
+static uint16_t secMin=0,secMax=0;
+static uint32_t secSum=0,secCount=0,secStartMs=0;
+static time_t secTime=0;
+static SupplySecond seconds[SUPPLY_SECONDS];
+static size_t secondsNext=0,secondsCount=0;
+
+uint16_t supplyMillivolts(uint16_t raw){
+  return (uint32_t)raw*SUPPLY_FULL_SCALE_MV/1023;
+}
+
+void supplySample(){
+  uint32_t head=ringHead;
+  if(head-ringTail>=SUPPLY_RING){
+    ringOverruns++;
+    return;
+  }
+  uint32_t i=head&(SUPPLY_RING-1);
+  ring[i]=hal.adc->read();
+  ringMs[i]=hal.clock->millis();
+  ringHead=head+1; // publish only once the sample is stored
+}
+
+static void endSecond(time_t t){
+  SupplySecond&s=seconds[secondsNext];
+  s.time=t<100000?0:(uint32_t)t;
+  s.minMv=secMin;
+  s.maxMv=secMax;
+  s.meanMv=secSum/secCount;
+  secondsNext=(secondsNext+1)%SUPPLY_SECONDS;
+  secondsCount=std::min(secondsCount+1,(size_t)SUPPLY_SECONDS);
+  secCount=secSum=0;
+}
+
+// From the first to the end of the last sample in the excursion, rounded
+// up to whole seconds, so a flicker logs as 1 s.
+static void endExcursion(bool logEvents){
+  uint8_t kind=status.state;
+  time_t dur=(excursionLastMs-excursionStartMs+SUPPLY_PERIOD_MS+999)/1000;
+  status.state=0;
+  if(kind==EV_SAG)status.sags++;
+  else status.swells++;
+  hal.console->println(String(kind==EV_SAG?"Supply sag to ":"Supply swell to ")+String((unsigned)status.extremeMv)+" mV for "+formatDuration(dur));
+  if(logEvents&&excursionStart>=100000)logEvent(kind,excursionStart,dur);
+}
+
+static void detect(uint16_t mv,uint32_t ms,time_t t,bool logEvents){
+  if(status.state==EV_SAG){
+    if(mv>SUPPLY_SAG_MV+SUPPLY_HYSTERESIS_MV)endExcursion(logEvents);
+    else status.extremeMv=std::min(status.extremeMv,mv);
+  }else if(status.state==EV_SWELL){
+    if(mv<SUPPLY_SWELL_MV-SUPPLY_HYSTERESIS_MV)endExcursion(logEvents);
+    else status.extremeMv=std::max(status.extremeMv,mv);
+  }
+  if(status.state==0&&(mv<SUPPLY_SAG_MV||mv>SUPPLY_SWELL_MV)){
+    status.state=mv<SUPPLY_SAG_MV?EV_SAG:EV_SWELL;
+    status.extremeMv=mv;
+    excursionStartMs=ms;
+    excursionStart=t;
+  }
+  if(status.state)excursionLastMs=ms;
+}
+
+// Wall time of a sample is now less its age by millis(). A second ends
+// with the first sample 1000 ms or more after its own first sample.
+void supplyPoll(bool logEvents){
+  uint32_t tail=ringTail;
+  uint32_t n=ringHead-tail;
+  time_t now=hal.clock->now();
+  uint32_t nowMs=hal.clock->millis(); // after the head was read
+  for(uint32_t i=0;i<n;i++){
+    uint32_t k=(tail+i)&(SUPPLY_RING-1);
+    uint16_t mv=supplyMillivolts(ring[k]);
+    uint32_t ms=ringMs[k];
+    time_t t=now-(time_t)((nowMs-ms)/1000);
+    if(haveLast)status.missed+=std::max((ms-lastMs+SUPPLY_PERIOD_MS/2)/SUPPLY_PERIOD_MS,(uint32_t)1)-1;
+    lastMs=ms;
+    haveLast=true;
+    if(secCount&&ms-secStartMs>=1000)endSecond(secTime);
+    if(secCount==0){
+      secMin=secMax=mv;
+      secStartMs=ms;
+    }
+    secMin=std::min(secMin,mv);
+    secMax=std::max(secMax,mv);
+    secSum+=mv;
+    secCount++;
+    secTime=t;
+    detect(mv,ms,t,logEvents);
+  }
+  ringTail=tail+n;
+  status.samples+=n;
+  status.overruns=ringOverruns;
+}
+
+const SupplyStatus&supplyStatus(){
+  return status;
+}
+
+bool supplySecond(size_t n,SupplySecond&s){
+  if(n>=secondsCount)return false;
+  s=seconds[(secondsNext+SUPPLY_SECONDS-1-n)%SUPPLY_SECONDS];
+  return true;
+}
+
+// Drops queued samples too; call with the sampling timer stopped.
+void resetSupply(){
+  ringTail=ringHead;
+  ringOverruns=0;
+  memset(&status,0,sizeof(status));
+  haveLast=false;
+  secCount=secSum=0;
+  secondsNext=secondsCount=0;
+}
+
+void writeSupplyJson(Print&out){
+  const SupplyStatus&st=status;
+  out.print("{\"rateHz\":");
+  out.print(SUPPLY_RATE_HZ);
+  out.print(",\"samples\":");
+  out.print(st.samples);
+  out.print(",\"overruns\":");
+  out.print(st.overruns);
+  out.print(",\"missed\":");
+  out.print(st.missed);
+  out.print(",\"sags\":");
+  out.print(st.sags);
+  out.print(",\"swells\":");
+  out.print(st.swells);
+  out.print(",\"state\":\"");
+  out.print(st.state?eventLabel(st.state):"NORMAL");
+  out.print("\",\"seconds\":[");
+  SupplySecond s;
+  for(size_t n=secondsCount;n-->0&&supplySecond(n,s);){
+    out.print("[");
+    out.print(s.time);
+    out.print(",");
+    out.print(s.minMv);
+    out.print(",");
+    out.print(s.meanMv);
+    out.print(",");
+    out.print(s.maxMv);
+    out.print(n?"],":"]");
+  }
+  out.print("]}");
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <Arduino.h>
+#include "powerlog.h"
+
+// Supply monitoring: the supply voltage, through a divider on A0, is
+// sampled SUPPLY_RATE_HZ times a second from a timer (hal.adc) and
+// handed to loop() through a single-producer/single-consumer ring:
+// supplySample() only moves the head, supplyPoll() only the tail.
+// supplyPoll() folds the samples into per-second min/mean/max and logs
+// SAG/SWELL events for threshold crossings, with hysteresis, so sags and
+// flicker that do not reset the chip are kept.
+//
+// The timer callback runs in the SDK's system context, which only gets
+// the CPU when loop() returns or yields. While a handler runs without
+// yielding no samples are taken, so each sample carries the millis() it
+// was read at: seconds, excursion starts and durations follow the clock
+// rather than the sample count, and the skipped periods are counted as
+// missed. The ring fills only when loop() keeps yielding (e.g. while
+// sending a long response) without reaching the scheduler.
+//
+// Off unless built with -DSUPPLY_SENSE=1 (see platformio.ini): a
+// floating A0 reads noise and would log spurious events.
+
+#ifndef SUPPLY_SENSE
+#define SUPPLY_SENSE 0
+#endif
+#define SUPPLY_RATE_HZ 50
+#define SUPPLY_RING 64 // samples, a power of two; 1.28 s between polls
+#define SUPPLY_POLL_INTERVAL 200
+#define SUPPLY_FULL_SCALE_MV 6000 // supply voltage at ADC 1023, set by the divider
+#define SUPPLY_SAG_MV 4500
+#define SUPPLY_SWELL_MV 5500
+#define SUPPLY_HYSTERESIS_MV 100 // a SAG ends above SAG+this, a SWELL below SWELL-this
+#define SUPPLY_SECONDS 60 // per-second summaries kept in RAM
+
+struct SupplySecond{
+  uint32_t time; // wall clock at the end of the second, 0 before NTP
+  uint16_t minMv;
+  uint16_t meanMv;
+  uint16_t maxMv;
+};
+
+struct SupplyStatus{
+  uint32_t samples; // consumed by supplyPoll()
+  uint32_t overruns; // samples dropped on a full ring
+  uint32_t missed; // sample periods the timer did not run in
+  uint32_t sags;
+  uint32_t swells;
+  uint8_t state; // 0, EV_SAG or EV_SWELL while an excursion lasts
+  uint16_t extremeMv; // lowest (SAG) or highest (SWELL) so far
+};
+
+uint16_t supplyMillivolts(uint16_t raw);
+
+// Producer, from the sampling timer: hal.adc->read() and
+// hal.clock->millis() into the ring. Never blocks or allocates; a sample
+// that finds the ring full is counted as an overrun and dropped.
+void supplySample();
+
+// Consumer, from the scheduler. Events are only logged when logEvents
+// is set (clock valid, boot events written); crossings are still
+// tracked otherwise.
+void supplyPoll(bool logEvents);
+
+const SupplyStatus&supplyStatus();
+// The n-th newest complete second, n=0 the last; false if there is none
+bool supplySecond(size_t n,SupplySecond&s);
+void resetSupply();
+
+// {"rateHz":..,"samples":..,"overruns":..,"missed":..,"sags":..,"swells":..,"state":"..",
+//  "seconds":[[time,min,mean,max],..]} oldest first, millivolts
+void writeSupplyJson(Print&out);
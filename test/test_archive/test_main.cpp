@@ -0,0 +1,145 @@
+// Archive codec: evicted records read back exactly, time ranges skip
+// whole blocks, re-archiving is idempotent and a torn tail is cut off.
+#include <unity.h>
+#include <vector>
+#include "powerlog.h"
+#include "native/hal_native.h"
+
+#define T0 1767225600 // 2026-01-01 06:00 local
+#define RECORDS 800
+
+static std::vector<LogRecord>logged;
+
+// OFF/ON pairs every 4.5 hours, two and a half months in all, with one
+// restart in every 50 records
+static void appendRecords(){
+  logged.clear();
+  for(size_t i=0;i<RECORDS;i++){
+    LogRecord r;
+    r.timestamp=T0+i/2*16200+(i%2?900:0);
+    if(i%50==49)r.type=EV_RESTART|(2<<4);
+    else r.type=i%2?EV_ON:EV_OFF;
+    r.duration=r.type==EV_OFF?900:0;
+    logged.push_back(r);
+  }
+  TEST_ASSERT_EQUAL(RECORDS,appendLogRecords(logged.data(),logged.size()));
+}
+
+static size_t readArchive(time_t from,time_t to,ArchiveReader&reader,std::vector<LogRecord>&out){
+  out.clear();
+  LogRecord r;
+  if(!reader.open())return 0;
+  reader.range(from,to);
+  while(reader.next(r)){
+    TEST_ASSERT_TRUE(reader.index-1<logged.size());
+    const LogRecord&want=logged[reader.index-1];
+    TEST_ASSERT_EQUAL(want.type,r.type);
+    TEST_ASSERT_EQUAL(want.timestamp,r.timestamp);
+    TEST_ASSERT_EQUAL(want.duration,r.duration);
+    out.push_back(r);
+  }
+  reader.close();
+  return out.size();
+}
+
+void setUp(){
+  mountNativeFs("test_archive_fs");
+  loadSegments();
+  clearLog();
+  archiveBudget=ARCHIVE_MAX_BYTES;
+}
+
+void tearDown(){}
+
+void test_round_trip(){
+  appendRecords();
+  TEST_ASSERT_EQUAL(RECORDS,archiveLogRecords(logFirst(),logTotal()));
+  ArchiveReader reader;
+  std::vector<LogRecord>out;
+  TEST_ASSERT_EQUAL(RECORDS,readArchive(0,0,reader,out));
+  TEST_ASSERT_EQUAL(0,reader.corrupt);
+  TEST_ASSERT_TRUE(archiveBytes()<RECORDS*sizeof(LogRecord)*2/3); // about 4.8 bytes per record
+}
+
+void test_range_skips_blocks(){
+  appendRecords();
+  archiveLogRecords(logFirst(),logTotal());
+  time_t from=logged[300].timestamp,to=logged[339].timestamp;
+  ArchiveReader reader;
+  std::vector<LogRecord>out;
+  TEST_ASSERT_EQUAL(40,readArchive(from,to,reader,out));
+  TEST_ASSERT_EQUAL(logged[300].timestamp,out.front().timestamp);
+  TEST_ASSERT_TRUE(reader.skipped>0);
+  TEST_ASSERT_TRUE(reader.blocks<reader.skipped);
+}
+
+void test_rearchive_is_idempotent(){
+  appendRecords();
+  TEST_ASSERT_EQUAL(400,archiveLogRecords(logFirst(),400));
+  size_t bytes=archiveBytes();
+  TEST_ASSERT_EQUAL(0,archiveLogRecords(logFirst(),400));
+  TEST_ASSERT_EQUAL(bytes,archiveBytes());
+  TEST_ASSERT_EQUAL(400,archiveLogRecords(logFirst(),logTotal()));
+  ArchiveReader reader;
+  std::vector<LogRecord>out;
+  TEST_ASSERT_EQUAL(RECORDS,readArchive(0,0,reader,out));
+}
+
+void test_torn_tail_is_cut(){
+  appendRecords();
+  archiveLogRecords(logFirst(),400);
+  size_t bytes=archiveBytes();
+  File f=hal.fs->open(archivePath(),"a");
+  f.write((const uint8_t*)"\x20\x05torn block",12);
+  f.close();
+  TEST_ASSERT_EQUAL(400,archiveLogRecords(logFirst(),logTotal()));
+  TEST_ASSERT_TRUE(archiveBytes()>bytes);
+  ArchiveReader reader;
+  std::vector<LogRecord>out;
+  TEST_ASSERT_EQUAL(RECORDS,readArchive(0,0,reader,out));
+  TEST_ASSERT_EQUAL(0,reader.corrupt);
+}
+
+void test_corrupt_block_stops_reader(){
+  appendRecords();
+  archiveLogRecords(logFirst(),logTotal());
+  // Flip a payload byte of the first block
+  File f=hal.fs->open(archivePath(),"r+");
+  uint8_t c;
+  f.seek(sizeof(LogHeader)+sizeof(ArchiveBlock)+3,SeekSet);
+  f.read(&c,1);
+  c^=0xFF;
+  f.seek(sizeof(LogHeader)+sizeof(ArchiveBlock)+3,SeekSet);
+  f.write(&c,1);
+  f.close();
+  ArchiveReader reader;
+  std::vector<LogRecord>out;
+  TEST_ASSERT_EQUAL(0,readArchive(0,0,reader,out));
+  TEST_ASSERT_EQUAL(1,reader.corrupt);
+}
+
+void test_trim_keeps_newest_blocks(){
+  appendRecords();
+  archiveBudget=1024;
+  archiveLogRecords(logFirst(),logTotal());
+  TEST_ASSERT_TRUE(archiveBytes()<=1024);
+  ArchiveReader reader;
+  std::vector<LogRecord>out;
+  size_t n=readArchive(0,0,reader,out);
+  TEST_ASSERT_TRUE(n>0&&n<RECORDS);
+  TEST_ASSERT_EQUAL(logged.back().timestamp,out.back().timestamp);
+}
+
+int main(){
+  setenv("TZ","<+06>-6",1);
+  tzset();
+  resetCalendarCache();
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_range_skips_blocks);
+  RUN_TEST(test_rearchive_is_idempotent);
+  RUN_TEST(test_torn_tail_is_cut);
+  RUN_TEST(test_corrupt_block_stops_reader);
+  RUN_TEST(test_trim_keeps_newest_blocks);
+  return UNITY_END();
+}
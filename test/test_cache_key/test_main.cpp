@@ -0,0 +1,94 @@
+// Response cache invalidation: the log part of the cache key (cache.h)
+// must move on every change that can alter a cached response, and only
+// then.
+#include <unity.h>
+#include "powerlog.h"
+#include "native/hal_native.h"
+
+#define T0 1767225600 // 2026-01-01 06:00 local
+#define SALT 0x1234567
+
+static void logRecord(uint8_t type,time_t t,time_t dur){
+  LogRecord r={type,(uint32_t)t,(uint32_t)dur};
+  TEST_ASSERT_EQUAL(1,appendLogRecords(&r,1));
+}
+
+void setUp(){
+  mountNativeFs("test_cache_key_fs");
+  loadSegments();
+  clearLog();
+  retentionMonths=RETENTION_MONTHS;
+  retentionBytes=0;
+}
+
+void tearDown(){}
+
+void test_stable_without_changes(){
+  logRecord(EV_OFF,T0,60);
+  uint32_t key=logStateKey(SALT,T0+120);
+  TEST_ASSERT_EQUAL(key,logStateKey(SALT,T0+120));
+  TEST_ASSERT_EQUAL(key,logStateKey(SALT,T0+1800)); // same hour
+  LogReader reader;
+  LogRecord r;
+  TEST_ASSERT_TRUE(reader.open());
+  while(reader.next(r)){}
+  reader.close();
+  TEST_ASSERT_EQUAL(key,logStateKey(SALT,T0+120)); // reading changes nothing
+}
+
+void test_moves_on_append(){
+  uint32_t key=logStateKey(SALT,T0);
+  logRecord(EV_OFF,T0,60);
+  TEST_ASSERT_NOT_EQUAL(key,logStateKey(SALT,T0));
+  key=logStateKey(SALT,T0);
+  logEvent(EV_ON,T0+60);
+  TEST_ASSERT_NOT_EQUAL(key,logStateKey(SALT,T0));
+}
+
+void test_failed_append_keeps_key(){
+  logRecord(EV_OFF,T0,60);
+  uint32_t key=logStateKey(SALT,T0);
+  TEST_ASSERT_EQUAL(0,appendLogRecords(nullptr,0));
+  TEST_ASSERT_EQUAL(key,logStateKey(SALT,T0));
+}
+
+void test_moves_on_clear(){
+  logRecord(EV_OFF,T0,60);
+  uint32_t key=logStateKey(SALT,T0);
+  clearLog();
+  TEST_ASSERT_NOT_EQUAL(key,logStateKey(SALT,T0));
+}
+
+void test_moves_on_eviction(){
+  for(int m=0;m<4;m++)logRecord(EV_OFF,T0+m*31*86400,60);
+  uint32_t key=logStateKey(SALT,T0);
+  size_t segmentCount=segments.size();
+  retentionMonths=RETENTION_MIN_MONTHS;
+  applyRetention();
+  TEST_ASSERT_TRUE(segments.size()<segmentCount);
+  TEST_ASSERT_NOT_EQUAL(key,logStateKey(SALT,T0));
+  key=logStateKey(SALT,T0);
+  applyRetention(); // nothing left to evict
+  TEST_ASSERT_EQUAL(key,logStateKey(SALT,T0));
+}
+
+void test_moves_with_hour_day_and_salt(){
+  uint32_t key=logStateKey(SALT,T0);
+  TEST_ASSERT_NOT_EQUAL(key,logStateKey(SALT,T0+3600));
+  TEST_ASSERT_NOT_EQUAL(key,logStateKey(SALT,T0+86400));
+  TEST_ASSERT_NOT_EQUAL(key,logStateKey(SALT+1,T0));
+}
+
+int main(){
+  setenv("TZ","<+06>-6",1);
+  tzset();
+  resetCalendarCache();
+  UNITY_BEGIN();
+  RUN_TEST(test_stable_without_changes);
+  RUN_TEST(test_moves_on_append);
+  RUN_TEST(test_failed_append_keeps_key);
+  RUN_TEST(test_moves_on_clear);
+  RUN_TEST(test_moves_on_eviction);
+  RUN_TEST(test_moves_with_hour_day_and_salt);
+  return UNITY_END();
+}
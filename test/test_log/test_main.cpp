@@ -0,0 +1,132 @@
+// Journal recovery: torn tails are truncated at boot, corrupt frames
+// further back are skipped by LogReader and left out of the exports.
+#include <unity.h>
+#include <string>
+#include "powerlog.h"
+#include "native/hal_native.h"
+
+#define T0 1767225600 // 2026-01-01 06:00 local
+
+struct StringPrint:public Print{
+  std::string s;
+  size_t write(uint8_t c)override{s+=(char)c;return 1;}
+};
+
+static void appendRecords(size_t n){
+  for(size_t i=0;i<n;i++){
+    LogRecord r={(uint8_t)(i%2?EV_ON:EV_OFF),(uint32_t)(T0+i*600),(uint32_t)(i%2?0:300)};
+    TEST_ASSERT_EQUAL(1,appendLogRecords(&r,1));
+  }
+}
+
+static String segment(){
+  return segmentPath(segments.back().month);
+}
+
+static void setBytes(size_t at,const uint8_t*data,size_t n){
+  File f=hal.fs->open(segment(),"r+");
+  f.seek(at,SeekSet);
+  f.write(data,n);
+  f.close();
+}
+
+static size_t frameAt(size_t i){
+  return sizeof(LogHeader)+i*sizeof(LogFrame);
+}
+
+void setUp(){
+  mountNativeFs("test_log_fs");
+  loadSegments();
+  clearLog();
+}
+
+void tearDown(){}
+
+void test_partial_frame_is_truncated(){
+  appendRecords(10);
+  File f=hal.fs->open(segment(),"a");
+  f.write((const uint8_t*)"\x09torn",5);
+  f.close();
+  loadSegments();
+  TEST_ASSERT_EQUAL(10,logTotal());
+  f=hal.fs->open(segment(),"r");
+  TEST_ASSERT_EQUAL(frameAt(10),f.size());
+  f.close();
+  appendRecords(1);
+  TEST_ASSERT_EQUAL(11,logTotal());
+}
+
+void test_uncommitted_tail_frames_are_dropped(){
+  appendRecords(10);
+  uint8_t zero=0;
+  setBytes(frameAt(9)+sizeof(LogFrame)-1,&zero,1); // commit byte
+  setBytes(frameAt(8)+1,&zero,1); // record, so the CRC fails
+  loadSegments();
+  TEST_ASSERT_EQUAL(8,logTotal());
+}
+
+void test_corrupt_frame_is_skipped(){
+  appendRecords(10);
+  uint8_t zero=0;
+  setBytes(frameAt(4)+1,&zero,1);
+  loadSegments();
+  TEST_ASSERT_EQUAL(10,logTotal()); // only the tail is recovered
+  LogReader reader;
+  LogRecord r;
+  size_t n=0;
+  TEST_ASSERT_TRUE(reader.open());
+  while(reader.next(r)){
+    TEST_ASSERT_NOT_EQUAL(4,reader.index-1);
+    n++;
+  }
+  TEST_ASSERT_EQUAL(1,reader.corrupt);
+  reader.close();
+  TEST_ASSERT_EQUAL(9,n);
+}
+
+// Spans many buffer refills; next() must not recurse per skipped frame
+void test_long_corrupt_run_is_skipped(){
+  appendRecords(2000);
+  std::string zeros(1980*sizeof(LogFrame),'\0');
+  setBytes(frameAt(10),(const uint8_t*)zeros.data(),zeros.size());
+  loadSegments();
+  TEST_ASSERT_EQUAL(2000,logTotal());
+  LogReader reader;
+  LogRecord r;
+  size_t n=0;
+  TEST_ASSERT_TRUE(reader.open());
+  while(reader.next(r))n++;
+  TEST_ASSERT_EQUAL(1980,reader.corrupt);
+  reader.close();
+  TEST_ASSERT_EQUAL(20,n);
+}
+
+void test_json_page_starting_at_corrupt_frame(){
+  appendRecords(10);
+  uint8_t zero=0;
+  setBytes(frameAt(0)+1,&zero,1);
+  loadSegments();
+  LogReader reader;
+  LogQuery q;
+  q.limit=5;
+  TEST_ASSERT_TRUE(reader.open());
+  resolveLogQuery(reader,q,0);
+  StringPrint out;
+  writeLogJson(out,reader,q);
+  TEST_ASSERT_EQUAL(std::string::npos,out.s.find("[,"));
+  TEST_ASSERT_NOT_EQUAL(std::string::npos,out.s.find("\"entries\":[{\"index\":1,"));
+  TEST_ASSERT_EQUAL(std::string::npos,out.s.find(",]"));
+}
+
+int main(){
+  setenv("TZ","<+06>-6",1);
+  tzset();
+  resetCalendarCache();
+  UNITY_BEGIN();
+  RUN_TEST(test_partial_frame_is_truncated);
+  RUN_TEST(test_uncommitted_tail_frames_are_dropped);
+  RUN_TEST(test_corrupt_frame_is_skipped);
+  RUN_TEST(test_long_corrupt_run_is_skipped);
+  RUN_TEST(test_json_page_starting_at_corrupt_frame);
+  return UNITY_END();
+}
@@ -0,0 +1,139 @@
+// Stats windows from the per-day aggregates against a brute-force scan
+// of the log: both must agree to the second for today, the last 7 and 15
+// days and the month, also after segments have been evicted.
+#include <unity.h>
+#include "powerlog.h"
+#include "native/hal_native.h"
+
+#define T0 1767225600 // 2026-01-01 06:00 local
+#define MONTHS 5
+
+static time_t logEnd;
+
+// Random OFF/ON pairs every 1-12 h, with the odd restart and sag, which
+// count in no window
+static void generateLog(uint32_t seed){
+  time_t t=T0;
+  while(t<T0+MONTHS*31*86400L){
+    seed=seed*1103515245+12345;
+    time_t gap=3600+(seed>>8)%(11*3600);
+    time_t off=1+(seed>>4)%gap;
+    fakeClock.set(t);
+    logEvent(EV_OFF,t,off);
+    fakeClock.set(t+off);
+    logEvent(EV_ON,t+off,gap-off);
+    if((seed>>20)%7==0)logEvent(EV_RESTART,t+off,0);
+    if((seed>>24)%5==0)logEvent(EV_SAG,t+off+1,3);
+    t+=gap;
+  }
+  logEnd=t;
+}
+
+static void scanWindow(time_t cutoff,time_t&off,time_t&on){
+  off=on=0;
+  LogReader reader;
+  LogRecord r;
+  TEST_ASSERT_TRUE(reader.open());
+  while(reader.next(r)){
+    if((time_t)r.timestamp<cutoff)continue;
+    if(EV_KIND(r.type)==EV_OFF)off+=r.duration;
+    else if(EV_KIND(r.type)==EV_ON)on+=r.duration;
+  }
+  reader.close();
+}
+
+// Local midnight starting the day (or, with day 1, the month) of t,
+// plus months
+static time_t localStart(time_t t,int day,int months=0){
+  struct tm tm=*localtime(&t);
+  if(day)tm.tm_mday=day;
+  tm.tm_mon+=months;
+  tm.tm_hour=tm.tm_min=tm.tm_sec=0;
+  tm.tm_isdst=-1;
+  return mktime(&tm);
+}
+
+static void checkStats(time_t now){
+  fakeClock.set(now);
+  Stats s=calculateStats();
+  time_t dayStart=localStart(now,0);
+  time_t monthStart=localStart(now,1);
+  time_t off,on;
+  scanWindow(dayStart,off,on);
+  TEST_ASSERT_EQUAL(off,s.todayOff);
+  TEST_ASSERT_EQUAL(on,s.todayOn);
+  scanWindow(now-7*86400,off,on);
+  TEST_ASSERT_EQUAL(off,s.last7Off);
+  TEST_ASSERT_EQUAL(on,s.last7On);
+  scanWindow(now-15*86400,off,on);
+  TEST_ASSERT_EQUAL(off,s.last15Off);
+  TEST_ASSERT_EQUAL(on,s.last15On);
+  scanWindow(monthStart,off,on);
+  TEST_ASSERT_EQUAL(off,s.monthOff);
+  TEST_ASSERT_EQUAL(on,s.monthOn);
+}
+
+// Mid-day, exactly at local midnight (the 7/15-day cutoffs then fall on
+// day starts too) and a second before it
+static void checkAround(time_t now){
+  time_t midnight=localStart(now+86400,0);
+  checkStats(now);
+  checkStats(midnight-1);
+  checkStats(midnight);
+}
+
+void setUp(){
+  mountNativeFs("test_stats_fs");
+  loadSegments();
+  clearLog();
+  retentionMonths=RETENTION_MONTHS;
+  retentionBytes=0;
+}
+
+void tearDown(){}
+
+void test_windows_match_scan(){
+  generateLog(12345);
+  checkAround(logEnd);
+  checkAround(logEnd+3*3600);
+  checkAround(logEnd+86400);
+}
+
+void test_windows_match_scan_after_eviction(){
+  generateLog(777);
+  size_t segmentCount=segments.size();
+  retentionMonths=RETENTION_MIN_MONTHS;
+  applyRetention();
+  TEST_ASSERT_TRUE(segments.size()<segmentCount);
+  checkAround(logEnd);
+  // As after a reboot: aggregates from their file, then rebuilt from the log
+  loadSegments();
+  loadAggregates();
+  checkAround(logEnd+7200);
+  rebuildAggregates();
+  checkAround(logEnd+7200);
+}
+
+// The month window restarts while the 7/15-day ones still reach back
+// into the previous month
+void test_windows_match_scan_at_month_start(){
+  generateLog(4242);
+  time_t nextMonth=localStart(logEnd,1,1);
+  checkStats(nextMonth-1);
+  checkStats(nextMonth);
+  checkStats(nextMonth+3600);
+  fakeClock.set(nextMonth+7200);
+  logEvent(EV_OFF,nextMonth+3600,600);
+  checkAround(nextMonth+7200);
+}
+
+int main(){
+  setenv("TZ","<+06>-6",1);
+  tzset();
+  resetCalendarCache();
+  UNITY_BEGIN();
+  RUN_TEST(test_windows_match_scan);
+  RUN_TEST(test_windows_match_scan_after_eviction);
+  RUN_TEST(test_windows_match_scan_at_month_start);
+  return UNITY_END();
+}
@@ -0,0 +1,64 @@
+// Navbar collapse toggle, replacing bootstrap.bundle.js.
+document.querySelectorAll('[data-bs-toggle=collapse]').forEach(function(b){
+  b.addEventListener('click',function(){
+    var t=document.querySelector(b.getAttribute('data-bs-target'));
+    var open=t.classList.toggle('show');
+    b.setAttribute('aria-expanded',open);
+  });
+});
+
+// Pages can be served from the response cache, so their volatile parts
+// are loaded separately: data-fragment='url' is replaced by that HTML,
+// and the data-live fields are filled from /api/status right away.
+var set=function(name,text){
+  document.querySelectorAll('[data-live='+name+']').forEach(function(e){e.textContent=text;});
+};
+var applyStatus=function(d){
+  set('uptime',d.uptimeText);
+  set('time',d.timeText);
+  set('heap',d.freeHeap);
+  if(d.rssi)set('rssi',d.rssi);
+};
+if(window.fetch){
+  document.querySelectorAll('[data-fragment]').forEach(function(e){
+    fetch(e.getAttribute('data-fragment')).then(function(r){return r.text();}).then(function(html){e.innerHTML=html;});
+  });
+  if(document.querySelector('[data-live]'))fetch('/api/status').then(function(r){return r.json();}).then(applyStatus);
+}
+
+// Live updates from /events: fields marked data-live='name' take the
+// latest value, and new log records are appended to the newest history page.
+if(window.EventSource&&document.querySelector('[data-live],[data-live-log],[data-fragment]')){
+  var es=new EventSource('/events');
+  es.addEventListener('status',function(m){
+    applyStatus(JSON.parse(m.data));
+  });
+  es.addEventListener('wifi',function(m){
+    var d=JSON.parse(m.data);
+    set('wifi',d.connected?'Connected':'Disconnected');
+    document.querySelectorAll('[data-live=wifi]').forEach(function(e){
+      e.className='badge '+(d.connected?'bg-success':'bg-secondary');
+    });
+  });
+  es.addEventListener('log',function(m){
+    var d=JSON.parse(m.data);
+    var body=document.querySelector('[data-live-log]');
+    if(!body)return;
+    var badge={ON:'badge badge-on',OFF:'badge badge-off',RESTART:'badge bg-secondary',SAG:'badge bg-warning text-dark',SWELL:'badge bg-info text-dark'}[d.type];
+    var row=body.insertRow(-1);
+    row.insertCell(-1).textContent=d.index+1;
+    var ev=row.insertCell(-1);
+    var b=document.createElement('span');
+    b.className=badge;
+    b.textContent=d.type;
+    ev.appendChild(b);
+    if(d.cause){
+      var c=document.createElement('small');
+      c.className='text-muted';
+      c.textContent=' '+d.cause;
+      ev.appendChild(c);
+    }
+    row.insertCell(-1).textContent=d.timeText;
+    row.insertCell(-1).textContent=d.durationText;
+  });
+}